@@ -0,0 +1,415 @@
+//
+// Created by Samuel Longauer on 17/10/2026.
+//
+
+// micro- and macro-benchmarks of the transcriber, the results are printed as one JSON document
+// every input is synthesized in-process (the checked-in recordings are only an optional extra end-to-end run),
+// so the numbers of two builds can be compared directly
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <complex>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include "audio_analysis.h"
+#include "audio_generation.h"
+#include "transcript_generation.h"
+#include "additive_synth.h"
+
+
+namespace fs = std::filesystem;
+
+struct BenchArgs{
+    std::string output_path; // stdout when empty
+    std::string samples_dir = AUDIO_SAMPLES_DIR;
+    double min_time = 0.2; // seconds of every measurement (spread over the repetitions)
+    int repetitions = 5;
+};
+
+struct BenchResult{
+    std::string group;
+    std::string name;
+    std::string params; // json object
+    size_t iterations = 0; // per repetition
+    double mean_ns = 0; // per iteration, over all repetitions
+    double min_ns = 0; // per iteration, the fastest repetition
+    double throughput = 0; // work per second of the fastest repetition
+    std::string unit;
+};
+
+// the benchmark body returns something depending on its work, so that the optimizer cannot drop it
+static volatile double sink;
+
+class Bench{
+public:
+    explicit Bench(const BenchArgs& args) : args(args){}
+
+    // measures fn, work is the amount of unit done by one call
+    void run(const std::string& group, const std::string& name, const std::string& params, double work, const std::string& unit, const std::function<double()>& fn);
+    void write_json(std::ostream& out) const;
+
+private:
+    using clock = std::chrono::steady_clock;
+    const BenchArgs& args;
+    std::vector<BenchResult> results;
+
+    static std::string escape(const std::string& st);
+};
+
+void Bench::run(const std::string& group, const std::string& name, const std::string& params, double work, const std::string& unit, const std::function<double()>& fn){
+    // warming the caches (fft plans, workspaces, page cache) and sizing a repetition to its share of min_time
+    auto start = clock::now();
+    sink = fn();
+    double once = std::chrono::duration<double>(clock::now() - start).count();
+    double budget = args.min_time/args.repetitions;
+    size_t iterations = once > 0 ? static_cast<size_t>(std::clamp(budget/once, 1.0, 1e9)) : 1000;
+
+    double total = 0, best = 0;
+    for (int r = 0; r<args.repetitions; r++){
+        start = clock::now();
+        double acc = 0;
+        for (size_t i = 0; i<iterations; i++) acc += fn();
+        sink = acc;
+        double elapsed = std::chrono::duration<double>(clock::now() - start).count();
+        total += elapsed;
+        if (r == 0 || elapsed < best) best = elapsed;
+    }
+
+    BenchResult result;
+    result.group = group;
+    result.name = name;
+    result.params = params;
+    result.iterations = iterations;
+    result.mean_ns = total/(static_cast<double>(iterations)*args.repetitions)*1e9;
+    result.min_ns = best/static_cast<double>(iterations)*1e9;
+    result.throughput = work*static_cast<double>(iterations)/best;
+    result.unit = unit;
+    results.push_back(result);
+    std::cerr << group << "/" << name << " " << params << ": " << result.min_ns/1e3 << " us, " << result.throughput << " " << unit << "\n";
+}
+
+std::string Bench::escape(const std::string& st){
+    std::string result;
+    for (char c : st){
+        if (c == '"' || c == '\\') result += '\\';
+        result += c;
+    }
+    return result;
+}
+
+void Bench::write_json(std::ostream& out) const{
+    out << "{\n  \"context\": {";
+    out << "\"compiler\": \"" << escape(__VERSION__) << "\", ";
+#ifdef __OPTIMIZE__
+    out << "\"optimized\": true, ";
+#else
+    out << "\"optimized\": false, ";
+#endif
+    out << "\"simd_level\": " << static_cast<int>(SpectralKernels<double>::get().level) << ", ";
+    out << "\"hardware_threads\": " << std::thread::hardware_concurrency() << ", ";
+    out << "\"repetitions\": " << args.repetitions << "},\n";
+    out << "  \"benchmarks\": [";
+    for (size_t i = 0; i<results.size(); i++){
+        const BenchResult& r = results[i];
+        out << (i ? ",\n" : "\n") << "    {\"group\": \"" << r.group << "\", \"name\": \"" << escape(r.name) << "\", \"params\": " << r.params
+            << ", \"iterations\": " << r.iterations << ", \"mean_ns\": " << r.mean_ns << ", \"min_ns\": " << r.min_ns
+            << ", \"throughput\": " << r.throughput << ", \"unit\": \"" << r.unit << "\"}";
+    }
+    out << "\n  ]\n}\n";
+}
+
+// a few seconds of chords on every channel, the notes change with every chord
+std::vector<channel_type> synthetic_chords(int num_channels, double seconds, double chord_length, int notes_per_chord){
+    std::vector<channel_type> channels(num_channels);
+    std::mt19937 random(42);
+    std::uniform_int_distribution<int> pitch(24, 96); // C2..C8
+    for (int c = 0; c<num_channels; c++){
+        for (double t = 0; t + 1e-9<seconds; t += chord_length){
+            segment_chord chord;
+            chord.start = t;
+            chord.duration = std::min(chord_length, seconds - t);
+            for (int k = 0; k<notes_per_chord; k++){
+                chord.notes.emplace_back(NoteClassifier::table[pitch(random)]);
+            }
+            std::sort(chord.notes.begin(), chord.notes.end());
+            channels[c].push_back(chord);
+        }
+    }
+    return channels;
+}
+
+// a chord of sines in the 16-bit range
+std::vector<int> synthetic_signal(size_t num_samples, int sample_rate, const std::vector<double>& frequencies){
+    std::vector<int> samples(num_samples);
+    for (size_t i = 0; i<num_samples; i++){
+        double value = 0;
+        for (double f : frequencies) value += std::sin(2*M_PI*f*static_cast<double>(i)/sample_rate);
+        samples[i] = static_cast<int>(value*20000/frequencies.size());
+    }
+    return samples;
+}
+
+std::string fmt_params(const std::vector<std::pair<const char*, std::string>>& fields){
+    std::ostringstream oss;
+    oss << "{";
+    for (size_t i = 0; i<fields.size(); i++){
+        oss << (i ? ", " : "") << "\"" << fields[i].first << "\": " << fields[i].second;
+    }
+    oss << "}";
+    return oss.str();
+}
+
+std::string json_string(const std::string& st){
+    return "\"" + st + "\"";
+}
+
+void bench_fft(Bench& bench){
+    // powers of two, a mixed-radix length (4 s at 44.1 kHz) and a prime length handled by Bluestein
+    for (size_t n : {256ul, 1024ul, 4096ul, 16384ul, 65536ul, 176400ul, 4099ul}){
+        const std::shared_ptr<const FFTPlan> plan = FFTPlan::get(n);
+        std::vector<std::complex<double>> data(n), work(n);
+        std::vector<double> real(n);
+        std::mt19937 random(1);
+        std::normal_distribution<double> noise;
+        for (size_t i = 0; i<n; i++){
+            real[i] = noise(random);
+            data[i] = {real[i], noise(random)};
+        }
+        // the conventional 5 N log2 N flop count of a complex transform, half of it for a real one
+        double flops = 5.0*n*std::log2(static_cast<double>(n));
+        std::string params = fmt_params({{"size", std::to_string(n)}});
+
+        bench.run("fft", "forward", params, flops/1e6, "Mflop/s", [&](){
+            std::copy(data.begin(), data.end(), work.begin());
+            plan->forward(work.data());
+            return work[1].real();
+        });
+        bench.run("fft", "inverse", params, flops/1e6, "Mflop/s", [&](){
+            std::copy(data.begin(), data.end(), work.begin());
+            plan->inverse(work.data());
+            return work[1].real();
+        });
+        bench.run("fft", "forward_real", params, flops/2e6, "Mflop/s", [&](){
+            plan->forwardReal(real.data(), work.data());
+            return work[1].real();
+        });
+
+        const std::shared_ptr<const BasicFFTPlan<float>> plan_f = BasicFFTPlan<float>::get(n);
+        std::vector<float> real_f(real.begin(), real.end());
+        std::vector<std::complex<float>> work_f(n);
+        bench.run("fft", "forward_real_float", params, flops/2e6, "Mflop/s", [&](){
+            plan_f->forwardReal(real_f.data(), work_f.data());
+            return work_f[1].real();
+        });
+    }
+}
+
+void bench_decode(Bench& bench, const fs::path& dir){
+    const double seconds = 30;
+    std::vector<channel_type> chords = synthetic_chords(2, seconds, 0.5, 4);
+    for (auto [format, label] : {std::pair{SampleFormat::pcm16, "pcm16"}, {SampleFormat::pcm24, "pcm24"}, {SampleFormat::float32, "float"}}){
+        fs::path path = dir / (std::string("decode_") + label + ".wav");
+        AudioOutputOptions options;
+        options.format = format;
+        generateAudio(path.string(), chords, options);
+        double megabytes = static_cast<double>(fs::file_size(path))/1e6;
+
+        bench.run("wav", "decode", fmt_params({{"format", json_string(label)}, {"channels", std::to_string(2)}, {"seconds", std::to_string(seconds)}}), megabytes, "MB/s", [&](){
+            WaveFile file(path.string());
+            return static_cast<double>(file.samples.at(1, file.samples.num_frames - 1));
+        });
+    }
+
+    // the deinterleave kernels alone, from memory into a preallocated planar buffer
+    const size_t frames = 1 << 20;
+    std::mt19937 rng(7);
+    for (int bits : {16, 24}){
+        for (int channels : {1, 2}){
+            WaveFormat format;
+            format.audio_format = 1;
+            format.num_channels = static_cast<short>(channels);
+            format.sample_rate = 48000;
+            format.bits_per_sample = static_cast<short>(bits);
+            format.block_align = static_cast<short>(format.frame_bytes());
+            format.byte_rate = format.sample_rate*format.block_align;
+            std::vector<uint8_t> data(frames*format.frame_bytes());
+            for (uint8_t& byte : data) byte = static_cast<uint8_t>(rng());
+            std::vector<int> planar(frames*channels);
+            DecodeKernel kernel = selectDecodeKernel(format);
+            bench.run("wav", "decode_kernel", fmt_params({{"bits", std::to_string(bits)}, {"channels", std::to_string(channels)}}), static_cast<double>(data.size())/1e6, "MB/s", [&](){
+                kernel(data.data(), frames, channels, planar.data(), frames);
+                return static_cast<double>(planar.back());
+            });
+        }
+    }
+}
+
+void bench_segments(Bench& bench){
+    const int sample_rate = 44100;
+    struct Variant {const char* name; AnalysisOptions options;};
+    std::vector<Variant> variants(4);
+    variants[0].name = "fft";
+    variants[1].name = "fft_float";
+    variants[1].options.precision = Precision::single_precision;
+    variants[2].name = "fft_matched";
+    variants[2].options.matched_fft_size = true;
+    variants[3].name = "cqt";
+    variants[3].options.engine = Engine::cqt;
+
+    std::vector<int> signal = synthetic_signal(sample_rate, sample_rate, {261.626, 329.628, 391.995, 523.251});
+    for (const Variant& variant : variants){
+        const AudioAnalyzer analyzer(0, 4, variant.options);
+        for (double length : {0.05, 0.1, 0.25, 0.5, 1.0}){
+            std::span<const int> segment(signal.data(), static_cast<size_t>(length*sample_rate));
+            segment_chord chord;
+            bench.run("analysis", std::string("segment_") + variant.name, fmt_params({{"seconds", std::to_string(length)}, {"notes", std::to_string(4)}}), 1, "segments/s", [&](){
+                analyzer.analyzeSegment(segment, sample_rate, chord, segment.size());
+                return chord.notes.empty() ? 0.0 : chord.notes[0].freq;
+            });
+        }
+    }
+}
+
+void bench_notes(Bench& bench){
+    // a sweep over the whole piano range and beyond, out of range frequencies included
+    std::vector<double> frequencies(4096);
+    for (size_t i = 0; i<frequencies.size(); i++) frequencies[i] = 10.0*std::pow(2.0, 10.5*static_cast<double>(i)/frequencies.size());
+    bench.run("notes", "classify", fmt_params({{"count", std::to_string(frequencies.size())}}), frequencies.size()/1e6, "Mnotes/s", [&](){
+        double acc = 0;
+        for (double f : frequencies) acc += NoteClassifier(f).cents;
+        return acc;
+    });
+}
+
+void bench_synthesis(Bench& bench, const fs::path& dir){
+    const int sample_rate = 44100;
+    const size_t block = 4096;
+    for (int notes : {1, 4, 8}){
+        std::vector<channel_type> chords = synthetic_chords(1, 10, 0.25, notes);
+        std::vector<double> out(block);
+        OscillatorBank bank(sample_rate, 32000);
+        size_t next = 0;
+        bench.run("synthesis", "oscillator_bank", fmt_params({{"notes", std::to_string(notes)}, {"block", std::to_string(block)}}), block/1e6, "Msamples/s", [&](){
+            while (bank.pending() < block){
+                bank.push(chords[0][next]);
+                next = (next + 1) % chords[0].size();
+            }
+            bank.render(out.data(), block);
+            return out[block - 1];
+        });
+    }
+
+    const double seconds = 30;
+    std::vector<channel_type> chords = synthetic_chords(2, seconds, 0.5, 4);
+    fs::path path = dir / "synthesis.wav";
+    for (unsigned threads : {1u, 2u}){
+        AudioOutputOptions options;
+        options.threads = threads;
+        bench.run("synthesis", "write_to_file", fmt_params({{"channels", std::to_string(2)}, {"notes", std::to_string(4)}, {"seconds", std::to_string(seconds)}, {"threads", std::to_string(threads)}}),
+                  2*seconds*sample_rate/1e6, "Msamples/s", [&](){
+            generateAudio(path.string(), chords, options);
+            return 0.0;
+        });
+    }
+}
+
+// analysis, audio reconstruction and transcript of one file, the throughput is seconds of audio per second
+void bench_end_to_end_file(Bench& bench, const std::string& name, const fs::path& input, const fs::path& dir){
+    double seconds;
+    {
+        WaveFile file(input.string());
+        seconds = static_cast<double>(file.samples.num_frames)/file.sample_rate;
+    }
+    for (Engine engine : {Engine::fft, Engine::cqt}){
+        AnalysisOptions options;
+        options.engine = engine;
+        const AudioAnalyzer analyzer(0.5, 4, options);
+        std::string params = fmt_params({{"engine", json_string(engine == Engine::cqt ? "cqt" : "fft")}, {"segment_size", std::to_string(0.5)}, {"notes", std::to_string(4)}, {"seconds", std::to_string(seconds)}});
+        bench.run("end_to_end", name, params, seconds, "x realtime", [&](){
+            channel_field data = analyzer.analyzeAudio(input.string());
+            generateAudio((dir / "end_to_end.wav").string(), data);
+            generateTranscript((dir / "end_to_end.txt").string(), data);
+            return static_cast<double>(data[0].size());
+        });
+    }
+}
+
+void bench_end_to_end(Bench& bench, const BenchArgs& args, const fs::path& dir){
+    fs::path synthetic = dir / "end_to_end_input.wav";
+    generateAudio(synthetic.string(), synthetic_chords(2, 30, 0.5, 4));
+    bench_end_to_end_file(bench, "synthetic", synthetic, dir);
+
+    if (args.samples_dir.empty() || !fs::is_directory(args.samples_dir)) return;
+    std::vector<fs::path> samples;
+    for (const fs::directory_entry& entry : fs::directory_iterator(args.samples_dir)){
+        if (entry.is_regular_file() && entry.path().extension() == ".wav") samples.push_back(entry.path());
+    }
+    std::sort(samples.begin(), samples.end());
+    for (const fs::path& sample : samples){
+        try {
+            bench_end_to_end_file(bench, sample.stem().string(), sample, dir);
+        }catch(const std::exception& e){
+            std::cerr << sample.string() << ": " << e.what() << "\n";
+        }
+    }
+}
+
+BenchArgs parse_bench_args(int argc, char *argv[]){
+    BenchArgs args;
+    std::vector<std::string> list(argv+1, argv+argc);
+    try {
+        for (size_t i = 0; i<list.size(); i++){
+            if (list[i] == "--output") args.output_path = list.at(i+1);
+            else if (list[i] == "--samples") args.samples_dir = list.at(i+1);
+            else if (list[i] == "--min_time") args.min_time = std::stod(list.at(i+1));
+            else if (list[i] == "--repetitions") args.repetitions = std::max(1, std::stoi(list.at(i+1)));
+            else continue;
+            i++;
+        }
+    }catch(...){
+        std::cerr << "usage: transcriber_bench [--output results.json] [--samples dir] [--min_time seconds] [--repetitions n]\n";
+        std::exit(1);
+    }
+    return args;
+}
+
+int main(int argc, char *argv[]){
+    BenchArgs args = parse_bench_args(argc, argv);
+    fs::path dir = fs::temp_directory_path() / ("transcriber_bench_" + std::to_string(std::random_device()()));
+    fs::create_directories(dir);
+
+    Bench bench(args);
+    try {
+        bench_fft(bench);
+        bench_decode(bench, dir);
+        bench_segments(bench);
+        bench_notes(bench);
+        bench_synthesis(bench, dir);
+        bench_end_to_end(bench, args, dir);
+    }catch(const std::exception& e){
+        std::cerr << e.what() << "\n";
+        fs::remove_all(dir);
+        return 1;
+    }
+    fs::remove_all(dir);
+
+    if (args.output_path.empty()){
+        bench.write_json(std::cout);
+    }else{
+        std::ofstream out(args.output_path);
+        if (!out.is_open()){
+            std::cerr << "The output file cannot be opened\n";
+            return 1;
+        }
+        bench.write_json(out);
+    }
+    return 0;
+}
@@ -0,0 +1,181 @@
+//
+// Created by Samuel Longauer on 17/10/2026.
+//
+
+#ifndef PROJECT_ADDITIVE_SYNTH_H
+#define PROJECT_ADDITIVE_SYNTH_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <deque>
+#include <vector>
+#include "note_classifier.h"
+#include "segment_chord.h"
+
+// additive synthesizer of one channel - every sounding note is a recursive sine generator (a phasor rotated by a fixed
+// angle per sample), kept as structure of arrays so the per-sample update vectorizes across the notes
+// a note that carries over into the next chord keeps its oscillator, so the phase stays continuous at segment boundaries;
+// only notes that start or stop are ramped in or out, and the gains of the held notes glide to the new balance
+class OscillatorBank {
+public:
+    OscillatorBank(int sample_rate, double amplitude) : sample_rate_(sample_rate), amplitude_(amplitude){}
+
+    // queues a chord, its samples are produced by the following render calls
+    void push(const segment_chord& chord);
+    size_t pending() const {return pending_;} // queued samples not rendered yet
+    // renders the next count samples (at most pending()) into out
+    void render(double* out, size_t count);
+
+    // number of samples a chord of the given duration lasts
+    static size_t chord_length(double duration, int sample_rate){
+        double samples = duration*sample_rate;
+        return samples > 0 ? static_cast<size_t>(std::ceil(samples)) : 0;
+    }
+
+private:
+    static constexpr size_t fade_length = 175; // samples of the ramps (about 4 ms at 44.1 kHz)
+
+    struct QueuedChord {
+        std::vector<NoteClassifier> notes;
+        size_t length;
+    };
+
+    int sample_rate_;
+    double amplitude_;
+    std::deque<QueuedChord> queue_;
+    size_t pending_ = 0;
+    size_t left_in_chord_ = 0; // samples of the front chord still to render (the front chord has been started)
+    bool started_ = false;
+
+    // oscillators
+    std::vector<int> midi_;
+    std::vector<double> re_, im_; // phasor, the output is its imaginary part (a sine starting at phase 0)
+    std::vector<double> cos_, sin_; // rotation per sample
+    std::vector<double> gain_, target_, step_;
+    size_t ramp_left_ = 0;
+
+    void start_chord_(const QueuedChord& chord);
+    void finish_ramp_();
+    void render_span_(double* out, size_t count, bool ramp);
+};
+
+void OscillatorBank::push(const segment_chord& chord){
+    size_t length = chord_length(chord.duration, sample_rate_);
+    if (length == 0) return;
+    queue_.push_back({chord.notes, length});
+    pending_ += length;
+}
+
+void OscillatorBank::start_chord_(const QueuedChord& chord){
+    // finishing a ramp in progress, the new one starts from the reached gains
+    for (double& target : target_) target = 0;
+    const double gain = chord.notes.empty() ? 0 : 1.0/static_cast<double>(chord.notes.size());
+
+    for (const NoteClassifier& note : chord.notes){
+        double angle = 2*M_PI*note.freq/sample_rate_;
+        size_t k = std::find(midi_.begin(), midi_.end(), note.midi) - midi_.begin();
+        if (k == midi_.size()){
+            midi_.push_back(note.midi);
+            re_.push_back(1);
+            im_.push_back(0);
+            cos_.push_back(0);
+            sin_.push_back(0);
+            gain_.push_back(0);
+            target_.push_back(0);
+            step_.push_back(0);
+        }
+        // a held note only changes its rotation, the phase carries on
+        cos_[k] = std::cos(angle);
+        sin_[k] = std::sin(angle);
+        target_[k] = gain;
+    }
+
+    ramp_left_ = std::min(fade_length, chord.length);
+    for (size_t k = 0; k<midi_.size(); k++){
+        step_[k] = (target_[k] - gain_[k])/static_cast<double>(ramp_left_);
+    }
+}
+
+// settling the gains exactly on their targets and dropping the oscillators that faded out
+void OscillatorBank::finish_ramp_(){
+    size_t kept = 0;
+    for (size_t k = 0; k<midi_.size(); k++){
+        if (target_[k] == 0) continue;
+        // the recursion slowly drifts off the unit circle, the magnitude is restored once per ramp
+        double norm = 1/std::sqrt(re_[k]*re_[k] + im_[k]*im_[k]);
+        midi_[kept] = midi_[k];
+        re_[kept] = re_[k]*norm;
+        im_[kept] = im_[k]*norm;
+        cos_[kept] = cos_[k];
+        sin_[kept] = sin_[k];
+        gain_[kept] = target_[k];
+        target_[kept] = target_[k];
+        step_[kept] = 0;
+        kept++;
+    }
+    midi_.resize(kept);
+    re_.resize(kept);
+    im_.resize(kept);
+    cos_.resize(kept);
+    sin_.resize(kept);
+    gain_.resize(kept);
+    target_.resize(kept);
+    step_.resize(kept);
+}
+
+void OscillatorBank::render_span_(double* out, size_t count, bool ramp){
+    const size_t n = midi_.size();
+    double* re = re_.data();
+    double* im = im_.data();
+    const double* c = cos_.data();
+    const double* s = sin_.data();
+    double* gain = gain_.data();
+    const double* step = step_.data();
+
+    for (size_t i = 0; i<count; i++){
+        double value = 0;
+        for (size_t k = 0; k<n; k++){
+            double r = re[k]*c[k] - im[k]*s[k];
+            double q = re[k]*s[k] + im[k]*c[k];
+            re[k] = r;
+            im[k] = q;
+            value += q*gain[k];
+        }
+        if (ramp){
+            for (size_t k = 0; k<n; k++) gain[k] += step[k];
+        }
+        out[i] = value*amplitude_;
+    }
+}
+
+void OscillatorBank::render(double* out, size_t count){
+    count = std::min(count, pending_);
+    pending_ -= count;
+
+    while (count > 0){
+        if (!started_ || left_in_chord_ == 0){
+            if (started_) queue_.pop_front();
+            start_chord_(queue_.front());
+            left_in_chord_ = queue_.front().length;
+            started_ = true;
+        }
+
+        size_t span = std::min(count, left_in_chord_);
+        size_t done = 0;
+        if (ramp_left_ > 0){
+            size_t ramped = std::min(span, ramp_left_);
+            render_span_(out, ramped, true);
+            ramp_left_ -= ramped;
+            done = ramped;
+            if (ramp_left_ == 0) finish_ramp_();
+        }
+        render_span_(out + done, span - done, false);
+
+        out += span;
+        count -= span;
+        left_in_chord_ -= span;
+    }
+}
+
+#endif //PROJECT_ADDITIVE_SYNTH_H
@@ -0,0 +1,32 @@
+//
+// Created by Samuel Longauer on 17/10/2026.
+//
+
+#ifndef PROJECT_ALLOCATION_COUNTER_H
+#define PROJECT_ALLOCATION_COUNTER_H
+
+#include <atomic>
+#include <cstddef>
+
+// number of heap allocations made through operator new by the whole process
+// only counted in programs linked with the replacement operators of allocation_hooks.cpp (the tests, the application
+// built with AUDIO_TRANSCRIBER_COUNT_ALLOCATIONS) and only after enable() - until then an allocation costs the hooks one
+// relaxed load; checking that a warmed-up pipeline stays allocation free is a matter of comparing two readings
+class AllocationCounter {
+public:
+    static bool enabled(){return enabled_.load(std::memory_order_relaxed);}
+    static void enable(){enabled_.store(true, std::memory_order_relaxed);}
+    static size_t count(){return allocations_.load(std::memory_order_relaxed);}
+    static size_t thread_count(){return thread_allocations_;} // made by the calling thread
+    static void record(){
+        allocations_.fetch_add(1, std::memory_order_relaxed);
+        thread_allocations_++;
+    }
+
+private:
+    static inline std::atomic<bool> enabled_{false};
+    static inline std::atomic<size_t> allocations_{0};
+    static inline thread_local size_t thread_allocations_ = 0;
+};
+
+#endif //PROJECT_ALLOCATION_COUNTER_H
@@ -9,157 +9,952 @@
 #include <fstream>
 #include <vector>
 #include <set>
+#include <array>
 #include <string>
 #include <complex>
 #include <algorithm>
+#include <span>
+#include <deque>
+#include <functional>
+#include <sstream>
+#include <atomic>
+#include <chrono>
+#include <cerrno>
+#include <cstdio>
+#include <memory>
+#include <thread>
 #include "wav_processing.h"
 #include "dft.h"
 #include "note_classifier.h"
+#include "segment_chord.h"
+#include "thread_pool.h"
+#include "cqt.h"
+#include "onset_detection.h"
+#include "channel_layout.h"
+#include "decimation.h"
+#include "sliding_dft.h"
+#include "spsc_ring.h"
+
+#if defined(__unix__) || defined(__APPLE__)
+#define AUDIO_TRANSCRIBER_HAS_POSIX_READ 1
+#include <unistd.h>
+#endif
 
 
 using namespace std;
-typedef std::pair<std::vector<NoteClassifier>, double> segment_chord;
 typedef std::vector<std::vector<segment_chord>> channel_field;
 
+enum class Precision {double_precision, single_precision};
+enum class Engine {fft, cqt};
+enum class Segmentation {fixed, onsets};
+
+// tuning of the analysis pipeline beyond the segment size and the number of extracted notes
+struct AnalysisOptions {
+    bool fast_fft_size = false; // rounding the padded segment up to a length that factors into 2, 3, 5 and 7
+    bool matched_fft_size = false; // transforming the segment zero-padded to twice its length instead of tiling it to 4 seconds
+    Precision precision = Precision::double_precision; // float halves the memory traffic, semitone resolution does not need more
+    double hop_size = 0; // seconds between consecutive STFT frames of segment_size length, 0 analyzes back-to-back segments
+    unsigned threads = 1; // workers analyzing the segments of all channels in parallel (the calling thread included)
+    Engine engine = Engine::fft; // cqt only measures the equal-tempered pitches instead of the full-resolution spectrum
+    int cqt_bins_per_octave = 12; // 12 (semitones) or 24 (quarter tones)
+    Segmentation segmentation = Segmentation::fixed; // onsets cuts the recording at the detected note events instead of every segment_size seconds
+    bool ranked_notes = false; // the notes of a segment ordered from the strongest peak instead of by frequency (the result cache keeps them so)
+    ChannelMode channel_mode = ChannelMode::each; // mono_mix and mid_side analyze a downmix instead of the channels of the file
+    double duplicate_threshold = 2; // above 1 only bit-identical channels share their notes, otherwise also the ones correlated at least this much
+    int target_rate = 0; // the channels are low-pass filtered and decimated to about this rate before the analysis, 0 keeps the rate of the file
+    SampleStorage sample_storage = SampleStorage::native; // type the loaded recording is kept in, every stage reads it in place
+};
+
+// counters of a live analysis
+struct LiveStats {
+    uint64_t frames = 0; // frames analyzed
+    uint64_t dropped_frames = 0; // frames discarded by the reader because the analysis fell behind
+    uint64_t rows = 0;
+    double mean_latency = 0; // seconds from the arrival of the last frame of a row until the row is handed over
+    double max_latency = 0;
+};
+
+// the strongest spectral peak of every recognized pitch - each peak is classified as soon as it is found,
+// so the top-K selection only has to rank (at most) NUM_NOTES candidates
+struct NotePeaks {
+    std::array<double, NUM_NOTES> power;
+    std::array<double, NUM_NOTES> frequency;
+
+    void clear(){power.fill(-1);}
+    void add(double peak_power, double peak_frequency){
+        NoteClassifier note(peak_frequency);
+        if (note.out_of_range) return;
+        int i = note.index();
+        if (peak_power > power[i]){
+            power[i] = peak_power;
+            frequency[i] = peak_frequency;
+        }
+    }
+};
+
+// buffers of the spectral stage, owned by the caller so that consecutive frames reuse them
+template<typename T>
+struct SpectrumScratch {
+    std::vector<std::complex<T>> spectrum;
+    std::vector<T> power_spectral_density;
+    std::vector<uint32_t> peak_indices;
+    NotePeaks peaks;
+    CqtScratch<T> cqt;
+};
+
+// every buffer of the segment pipeline, one workspace per thread - once it has grown to the largest segment
+// (reserve is called with it before the first segment) analyzing a segment does not touch the heap
+template<typename T>
+struct AnalysisWorkspace {
+    std::vector<T> samples; // the segment converted to T (or the ring buffer of the STFT)
+    std::vector<T> time_domain_data; // the windowed and padded fft input
+    std::vector<T> window; // Hann window of the last segment length, recomputed only when the length changes
+    SpectrumScratch<T> spectrum;
+
+    static AnalysisWorkspace& local(){
+        thread_local AnalysisWorkspace workspace;
+        return workspace;
+    }
+    // the window of a segment of n samples (without building an fft plan of that length)
+    const std::vector<T>& hann(size_t n){
+        if (window.size() != n) hannWindow(n, window);
+        return window;
+    }
+    void reserve(size_t num_samples, size_t fft_size){
+        samples.reserve(num_samples);
+        window.reserve(num_samples);
+        time_domain_data.reserve(fft_size);
+        spectrum.spectrum.reserve(fft_size/2 + 1);
+        spectrum.power_spectral_density.reserve(fft_size/2 + 1);
+        spectrum.peak_indices.reserve(fft_size/2 + 1);
+    }
+};
+
 class AudioAnalyzer {
 private:
     double frequency;
     int num_dominant;
-
-    static std::vector<int> strip_leading_zeros(std::vector<int>& vect);
-    static std::vector<std::complex<double>> time_domain_preprocessing(std::vector<double>& pcm, int num_samples, int sample_rate);
-    segment_chord analyzeSegment(std::vector<int>& segment, int sample_rate) const;
-    std::vector<segment_chord> analyzeChannel(std::vector<int>& channel, int sample_rate);
+    AnalysisOptions options;
+
+    template<typename S>
+    static std::span<const S> strip_leading_zeros(std::span<const S> vect);
+    static std::vector<std::pair<size_t, size_t>> segment_layout(size_t num_samples, double window_size);
+    size_t fft_size(size_t num_samples, int sample_rate) const;
+    template<typename T>
+    void pad_time_domain(std::vector<T>& time_domain_data, size_t num_samples, int sample_rate) const;
+    template<typename T, typename S>
+    void analyzeSegmentAs(std::span<const S> segment, int sample_rate, segment_chord& chord, size_t largest_segment) const;
+    template<typename T>
+    void dominantNotes(const std::vector<T>& time_domain_data, int sample_rate, SpectrumScratch<T>& scratch, std::vector<NoteClassifier>& notes) const;
+    template<typename T>
+    void cqtNotes(const T* samples, size_t num_samples, int sample_rate, SpectrumScratch<T>& scratch, std::vector<NoteClassifier>& notes) const;
+    void selectNotes(const NotePeaks& peaks, std::vector<NoteClassifier>& notes) const;
+    template<typename S>
+    std::vector<segment_chord> analyzeChannel(std::span<const S> samples, int sample_rate) const;
+    template<typename S>
+    channel_field analyzeChannels(const std::vector<std::span<const S>>& file_channels, int file_sample_rate) const;
+    template<typename S>
+    void planChannel(std::span<const S> samples, int sample_rate, double segment_size, std::vector<segment_chord>& result, std::vector<std::function<void()>>& tasks) const;
+    template<typename S>
+    void planSegments(std::span<const S> channel, int sample_rate, double offset, const std::vector<std::pair<size_t, size_t>>& layout, std::vector<segment_chord>& result, std::vector<std::function<void()>>& tasks) const;
+    template<typename S>
+    static std::vector<std::pair<size_t, size_t>> onset_layout(const std::vector<std::span<const S>>& channels, int sample_rate);
+    template<typename T, typename S>
+    void analyzeFramesStft(std::span<const S> channel, int sample_rate, double segment_size, size_t first_frame, segment_chord* frames, size_t num_frames) const;
+    void runTasks(std::vector<std::function<void()>>& tasks) const;
+
+    std::shared_ptr<WorkStealingPool> pool; // only present with more than one thread
 
 public:
-    explicit AudioAnalyzer(double frequency=0, int num_dominant=1) : frequency(frequency), num_dominant(num_dominant){};
-    channel_field analyzeAudio(const std::string& filePath);
+    explicit AudioAnalyzer(double frequency=0, int num_dominant=1, AnalysisOptions options=AnalysisOptions()) : frequency(frequency), num_dominant(num_dominant), options(options){
+        if (options.threads > 1) pool = std::make_shared<WorkStealingPool>(options.threads);
+    };
+    // both analyses throw std::runtime_error when the file cannot be read, the analyzer itself is never modified
+    // so a single instance can serve several files at once
+    channel_field analyzeAudio(const std::string& filePath) const;
+    int notes_per_segment() const {return num_dominant;}
+    // textual form of every setting the extracted notes depend on, apart from the number of notes per segment
+    std::string parameters() const;
+    // the same analysis with depth notes per segment ordered from the strongest, sharing the thread pool of this one
+    AudioAnalyzer ranked(int depth) const;
+    // constant-memory alternative to analyzeAudio - the file is read in blocks of one segment and every finished row
+    // (the segment_chord of each channel for one segment) is handed to on_row as soon as it is available, channels are not checked for duplicates
+    void analyzeStream(const std::string& filePath, const std::function<void(const std::vector<segment_chord>&)>& on_row) const;
+    // low-latency analysis of raw interleaved PCM (little-endian, described by format) read from input until its end
+    // a reader thread hands the input over a lock-free ring to a sliding DFT at the 108 pitches, which is sampled every
+    // segment_size seconds (0.1 by default) - every row goes to on_row as soon as its last frame is processed
+    // wait_for_analysis makes the reader wait when the ring is full (inputs faster than real time), otherwise input is dropped
+    LiveStats analyzeLive(std::FILE* input, const WaveFormat& format, bool wait_for_analysis, const std::function<void(const std::vector<segment_chord>&)>& on_row) const;
+    // the notes and the duration of a single segment (chord.start is left to the caller), read in place from the
+    // samples of any stored type S (int, int16_t or float)
+    // largest_segment sizes the workspace of the calling thread up front, so that later (longer) segments do not reallocate
+    template<typename S>
+    void analyzeSegment(std::span<const S> segment, int sample_rate, segment_chord& chord, size_t largest_segment = 0) const;
 };
 
-std::vector<int> AudioAnalyzer::strip_leading_zeros(std::vector<int>& vect){
-    std::vector<int> result;
-    for (auto&& x : vect){
-        if (x == 0) continue;
-        result.push_back(x);
+template<typename S>
+std::span<const S> AudioAnalyzer::strip_leading_zeros(std::span<const S> vect){
+    size_t first = 0;
+    while (first < vect.size() && vect[first] == 0) first++;
+    return vect.subspan(first);
+}
+
+// (start, length) of the consecutive segments a channel of num_samples samples is split into
+// full windows are ceil(window_size) samples long, the remainder forms a shorter last segment
+std::vector<std::pair<size_t, size_t>> AudioAnalyzer::segment_layout(size_t num_samples, double window_size){
+    std::vector<std::pair<size_t, size_t>> layout;
+    auto num_samples_left = static_cast<double>(num_samples);
+    size_t window_length = window_size > 0 ? static_cast<size_t>(std::ceil(window_size)) : num_samples;
+    size_t curr_sample = 0;
+
+    while (window_size > 0 && window_size<=num_samples_left && curr_sample<num_samples){
+        size_t length = std::min(window_length, num_samples - curr_sample);
+        layout.emplace_back(curr_sample, length);
+        curr_sample += length;
+        num_samples_left -= window_size;
     }
+    if (curr_sample<num_samples) layout.emplace_back(curr_sample, num_samples - curr_sample);
 
-    return result;
+    return layout;
+}
+
+// length of the fft input for a segment of num_samples samples
+size_t AudioAnalyzer::fft_size(size_t num_samples, int sample_rate) const{
+    // the interpolated peaks do not need the fine bins, zero padding to twice the length only keeps the peaks well sampled
+    if (options.matched_fft_size) return nextFastSize(2*num_samples);
+
+    // potentially padding time_domain_data to ensure at lest 1 hz resolution after applying dft
+    // the fft handles any length, rounding up to a fast size only trades a slightly longer transform for fewer passes
+    // beyond 4 seconds the length follows the segment, every other length would need its own (mostly Bluestein) plan
+    const size_t min_size = 4*static_cast<size_t>(sample_rate);
+    size_t size = std::max(num_samples, min_size);
+    return options.fast_fft_size || size > min_size ? nextFastSize(size) : size;
 }
 
-std::vector<std::complex<double>> AudioAnalyzer::time_domain_preprocessing(std::vector<double>& pcm, int num_samples, int sample_rate){
-    // potentially padding time_domain_data with zeroes to ensure at lest 1 hz resolution after applying dft
-    std::vector<std::complex<double>> time_domain_data(max(num_samples, 4*sample_rate));
-    int i = 0;
-    for (; i<num_samples; i++){
-        time_domain_data[i] = complex<double>(static_cast<double>(pcm[i]), 0);
+template<typename T>
+void AudioAnalyzer::pad_time_domain(std::vector<T>& time_domain_data, size_t num_samples, int sample_rate) const{
+    // the windowed segment occupies the first num_samples values, the rest of the fft input is zeros or its repetitions
+    const size_t size = fft_size(num_samples, sample_rate);
+    time_domain_data.resize(size);
+
+    if (options.matched_fft_size){
+        std::fill(time_domain_data.begin() + num_samples, time_domain_data.end(), T(0));
+        return;
     }
-    for(; i<4*sample_rate; i++){
-        time_domain_data[i] = complex<double>(pcm[i%num_samples], 0);
+    for (size_t i = num_samples; i<size; i++){
+        time_domain_data[i] = time_domain_data[i%num_samples];
     }
+}
 
-    return time_domain_data;
+template<typename S>
+void AudioAnalyzer::analyzeSegment(std::span<const S> segment, int sample_rate, segment_chord& chord, size_t largest_segment) const{
+    if (options.precision == Precision::single_precision) analyzeSegmentAs<float, S>(segment, sample_rate, chord, largest_segment);
+    else analyzeSegmentAs<double, S>(segment, sample_rate, chord, largest_segment);
 }
 
-segment_chord AudioAnalyzer::analyzeSegment(std::vector<int>& segment, int sample_rate) const{
+// T is the precision of the whole spectral pipeline (windowing, fft, power spectral density and the peak scan)
+template<typename T, typename S>
+void AudioAnalyzer::analyzeSegmentAs(std::span<const S> segment, int sample_rate, segment_chord& chord, size_t largest_segment) const{
+    ProfileTimer timer(ProfileStage::segment, segment.size_bytes());
     int num_samples = static_cast<int>(segment.size());
-    double duration = static_cast<double>(num_samples)/sample_rate; // duration of the recording in seconds
+    chord.duration = static_cast<double>(num_samples)/sample_rate; // duration of the recording in seconds
+
+    AnalysisWorkspace<T>& workspace = AnalysisWorkspace<T>::local(); // every worker reuses its own buffers
+    largest_segment = std::max(largest_segment, segment.size());
+    workspace.reserve(largest_segment, fft_size(largest_segment, sample_rate));
+
+    if (options.engine == Engine::cqt){
+        std::vector<T>& dsegment = workspace.samples;
+        dsegment.resize(num_samples);
+        std::copy(segment.begin(), segment.end(), dsegment.begin());
+        cqtNotes(dsegment.data(), dsegment.size(), sample_rate, workspace.spectrum, chord.notes); // the kernels are windowed themselves
+        return;
+    }
 
-    std::vector<double> dsegment;
-    dsegment.reserve(num_samples);
-    for (int i : segment){
-        dsegment.emplace_back(static_cast<double>(i));
+    {
+        ProfileTimer windowing(ProfileStage::windowing, segment.size_bytes());
+        // the samples are converted and windowed straight into the fft input, then padded behind
+        std::vector<T>& time_domain_data = workspace.time_domain_data;
+        time_domain_data.resize(num_samples);
+        const std::vector<T>& window = workspace.hann(num_samples);
+        SpectralKernels<T>::get().window(segment.data(), window.data(), time_domain_data.data(), num_samples);
+        pad_time_domain(time_domain_data, num_samples, sample_rate);
     }
-    applyHannWindow(dsegment);
 
-    // construct a complex vector - input for the fft
-    std::vector<std::complex<double>> time_domain_data = time_domain_preprocessing(dsegment, num_samples, sample_rate);
-    num_samples = static_cast<int>(time_domain_data.size());
+    dominantNotes(workspace.time_domain_data, sample_rate, workspace.spectrum, chord.notes);
+}
 
-    // convert time domain data input to the frequency domain using fft + scaling
-    vector<complex<double>> frequency_domain_data;
-    frequency_domain_data = FFT(time_domain_data);
+// the num_dominant strongest notes in the spectrum of the windowed (and padded) time_domain_data, ordered by frequency
+template<typename T>
+void AudioAnalyzer::dominantNotes(const std::vector<T>& time_domain_data, int sample_rate, SpectrumScratch<T>& scratch, std::vector<NoteClassifier>& notes) const{
+    const SpectralKernels<T>& kernels = SpectralKernels<T>::get();
+    int num_samples = static_cast<int>(time_domain_data.size());
+
+    // convert time domain data input to the frequency domain using the real-input fft (only bins up to the Nyquist frequency)
+    vector<complex<T>>& frequency_domain_data = scratch.spectrum;
+    frequency_domain_data.resize(num_samples/2 + 1);
+    BasicFFTPlan<T>::get(time_domain_data.size())->forwardReal(time_domain_data.data(), frequency_domain_data.data());
+
+    // only the bins a note can be classified from are used: peaks between C0 and B8 (a quarter tone beyond each),
+    // their parabolic refinement moves them by at most half a bin and needs both neighbours
+    const double bin_width = static_cast<double>(sample_rate)/num_samples;
+    const size_t num_bins = frequency_domain_data.size();
+    const double lowest = NoteClassifier::table.front()/QUARTER_STEP/bin_width - 0.5;
+    const double highest = NoteClassifier::table.back()*QUARTER_STEP/bin_width + 0.5;
+    const size_t first_bin = static_cast<size_t>(std::max(0.0, std::floor(lowest) - 1));
+    const size_t end_bin = std::min(num_bins, static_cast<size_t>(std::ceil(highest)) + 2);
 
     // compute the power spectral density of the transformed data
-    vector<double> power_spectral_density = powerSpectralDensity(frequency_domain_data, num_samples, sample_rate);
-
-    double maxPSD = 0.0;
-    for (auto&& x : power_spectral_density){
-        maxPSD = max(maxPSD, x);
+    vector<T>& power_spectral_density = scratch.power_spectral_density;
+    power_spectral_density.resize(num_bins);
+    {
+        ProfileTimer timer(ProfileStage::psd, (end_bin - std::min(first_bin, end_bin))*sizeof(complex<T>));
+        powerSpectralDensity(frequency_domain_data.data(), num_samples, sample_rate, power_spectral_density.data(), first_bin, end_bin);
     }
 
     // localizing the peaks in the graph of power spectral density
-    vector<pair<double, double>> power_peaks;
-    for (int i = 1; i<power_spectral_density.size()-1; i++){
-        if (power_spectral_density[i-1]<power_spectral_density[i] && power_spectral_density[i] > power_spectral_density[i+1]){
-            power_peaks.emplace_back(power_spectral_density[i]/maxPSD*1000, static_cast<double>(i)*sample_rate/num_samples);
+    NotePeaks& peaks = scratch.peaks;
+    peaks.clear();
+    const size_t scan_begin = std::max<size_t>(1, first_bin + 1);
+    const size_t scan_end = std::min(num_bins - 1, end_bin - 1);
+    if (num_bins > 2 && scan_begin < scan_end){
+        ProfileTimer timer(ProfileStage::peaks, (scan_end - scan_begin)*sizeof(T));
+        scratch.peak_indices.resize(scan_end - scan_begin);
+        size_t num_peaks = kernels.localMaxima(power_spectral_density.data(), scan_begin, scan_end, scratch.peak_indices.data());
+        for (size_t j = 0; j<num_peaks; j++){
+            uint32_t i = scratch.peak_indices[j];
+            // refining the peak between the bins with a parabola through the logarithms of the neighbouring powers
+            // (exact for a gaussian main lobe, close for the Hann window)
+            double delta = 0;
+            double left = power_spectral_density[i-1], center = power_spectral_density[i], right = power_spectral_density[i+1];
+            if (left > 0 && right > 0){
+                double l = std::log(left), c = std::log(center), r = std::log(right);
+                double curvature = l - 2*c + r;
+                if (curvature < 0) delta = 0.5*(l - r)/curvature;
+            }
+            peaks.add(center, (i + delta)*sample_rate/num_samples);
         }
     }
 
-    // sorting the peaks in decreasing order (which corresponds to the significance of the given frequencies in the original recording)
-    sort(power_peaks.begin(), power_peaks.end(), [](const std::pair<double,double>& a, const std::pair<double,double>& b){return a.first > b.first;});
+    selectNotes(peaks, notes);
+}
 
-    // converting the most dominant concurrent frequencies (within the analyzed segment) to their musical representation
-    vector<NoteClassifier> result;
-    set<string> notes;
-    int cnt = 0;
-    for (int i = 0; i<power_peaks.size(); i++){
-        NoteClassifier note(power_peaks[i].second);
-        if (cnt>num_dominant-1) break;
-        if (note.repr.empty()) continue;
-        if (notes.find(note.repr) == notes.end()){
-            notes.insert(note.repr);
-            result.push_back(note);
-            cnt++;
+// the notes of the strongest peaks in the constant-Q spectrum, ordered by frequency
+template<typename T>
+void AudioAnalyzer::cqtNotes(const T* samples, size_t num_samples, int sample_rate, SpectrumScratch<T>& scratch, std::vector<NoteClassifier>& notes) const{
+    const ConstantQTransform<T>& cqt = ConstantQTransform<T>::get(sample_rate, options.cqt_bins_per_octave);
+    vector<T>& power = scratch.power_spectral_density;
+    {
+        ProfileTimer timer(ProfileStage::cqt, num_samples*sizeof(T));
+        cqt.powers(samples, num_samples, power, scratch.cqt);
+    }
+
+    NotePeaks& peaks = scratch.peaks;
+    peaks.clear();
+    if (power.size() > 2){
+        ProfileTimer timer(ProfileStage::peaks, power.size()*sizeof(T));
+        const SpectralKernels<T>& kernels = SpectralKernels<T>::get();
+        scratch.peak_indices.resize(power.size());
+        size_t num_peaks = kernels.localMaxima(power.data(), 1, power.size()-1, scratch.peak_indices.data());
+        for (size_t j = 0; j<num_peaks; j++){
+            uint32_t i = scratch.peak_indices[j];
+            double frequency = cqt.frequency(i);
+            if (cqt.bins_per_octave() > 12){
+                // quarter-tone bins locate the pitch between the bin centers (parabola through the neighbouring bins)
+                double left = power[i-1], center = power[i], right = power[i+1];
+                double denominator = left - 2*center + right;
+                double delta = denominator != 0 ? 0.5*(left - right)/denominator : 0;
+                frequency *= std::pow(2.0, delta/cqt.bins_per_octave());
+            }
+            peaks.add(power[i], frequency);
         }
+    }
+
+    selectNotes(peaks, notes);
+}
 
+// the num_dominant pitches with the strongest peaks (which corresponds to their significance in the original recording),
+// ranked with a min-heap of num_dominant entries and stored into notes in increasing order of frequency
+void AudioAnalyzer::selectNotes(const NotePeaks& peaks, std::vector<NoteClassifier>& notes) const{
+    ProfileTimer timer(ProfileStage::classification);
+    const size_t k = static_cast<size_t>(std::clamp(num_dominant, 0, NUM_NOTES));
+    std::array<std::pair<double, int>, NUM_NOTES> heap;
+    size_t heap_size = 0;
+    auto stronger = [](const std::pair<double, int>& a, const std::pair<double, int>& b){return a.first > b.first;};
+
+    for (int i = 0; i<NUM_NOTES && k>0; i++){
+        if (peaks.power[i] < 0) continue; // no peak of this pitch
+        if (heap_size < k){
+            heap[heap_size++] = {peaks.power[i], i};
+            push_heap(heap.begin(), heap.begin() + heap_size, stronger);
+        }else if (peaks.power[i] > heap[0].first){
+            pop_heap(heap.begin(), heap.begin() + heap_size, stronger);
+            heap[heap_size-1] = {peaks.power[i], i};
+            push_heap(heap.begin(), heap.begin() + heap_size, stronger);
+        }
     }
-    sort(result.begin(), result.end());
-    return make_pair(result, duration);
+
+    // converting the most dominant concurrent frequencies (within the analyzed segment) to their musical representation
+    notes.clear();
+    if (options.ranked_notes){
+        sort(heap.begin(), heap.begin() + heap_size, [](const std::pair<double, int>& a, const std::pair<double, int>& b){
+            return a.first != b.first ? a.first > b.first : a.second < b.second;
+        });
+    }
+    for (size_t i = 0; i<heap_size; i++){
+        notes.emplace_back(peaks.frequency[heap[i].second]);
+    }
+    if (!options.ranked_notes) sort(notes.begin(), notes.end());
 }
 
-std::vector<segment_chord> AudioAnalyzer::analyzeChannel(std::vector<int>& channel, int sample_rate){
+template<typename S>
+std::vector<segment_chord> AudioAnalyzer::analyzeChannel(std::span<const S> samples, int sample_rate) const{
+    ProfileTimer timer(ProfileStage::analysis, samples.size_bytes());
     vector<segment_chord> result;
-    channel = strip_leading_zeros(channel); // leaving out the silent part at the beginning of the recording from the analysis
-    int num_samples = static_cast<int>(channel.size());
-    vector<int> segment;
-    double window_size = frequency*sample_rate;
-    auto num_samples_left = (double)num_samples;
-    int curr_sample = 0;
+    vector<function<void()>> tasks;
+    if (options.segmentation == Segmentation::onsets){
+        planSegments(samples, sample_rate, 0, onset_layout(std::vector<std::span<const S>>{samples}, sample_rate), result, tasks);
+    }else{
+        planChannel(samples, sample_rate, frequency > 0 ? frequency : static_cast<double>(samples.size())/sample_rate, result, tasks);
+    }
+    runTasks(tasks);
+    return result;
+}
 
-    while(window_size<=num_samples_left){
-        for (int i = 0; i<window_size; i++){
-            segment.push_back(channel[curr_sample++]);
+// sizes result to the final number of segments (frames) of the channel and adds one task per independent unit of work
+// every task only writes its own elements of result, so the order of the output does not depend on the scheduling
+// segment_size is the length of the segments (STFT frames) in seconds
+template<typename S>
+void AudioAnalyzer::planChannel(std::span<const S> samples, int sample_rate, double segment_size, std::vector<segment_chord>& result, std::vector<std::function<void()>>& tasks) const{
+    std::span<const S> channel = strip_leading_zeros(samples); // leaving out the silent part at the beginning of the recording from the analysis
+    double offset = static_cast<double>(samples.size() - channel.size())/sample_rate;
+
+    if (options.hop_size > 0){
+        size_t hop = std::max<size_t>(1, static_cast<size_t>(std::lround(options.hop_size*sample_rate)));
+        size_t num_frames = (channel.size() + hop - 1)/hop;
+        result.assign(num_frames, segment_chord());
+        for (segment_chord& chord : result) chord.notes.reserve(num_dominant);
+
+        // frames are handed out in blocks, each block fills its own ring buffer
+        constexpr size_t frames_per_task = 32;
+        for (size_t first = 0; first<num_frames; first+=frames_per_task){
+            size_t count = std::min(frames_per_task, num_frames - first);
+            segment_chord* frames = result.data() + first;
+            tasks.emplace_back([this, channel, sample_rate, segment_size, first, frames, count, offset](){
+                if (options.precision == Precision::single_precision) analyzeFramesStft<float, S>(channel, sample_rate, segment_size, first, frames, count);
+                else analyzeFramesStft<double, S>(channel, sample_rate, segment_size, first, frames, count);
+                for (size_t i = 0; i<count; i++) frames[i].start += offset;
+            });
         }
-        num_samples_left -= window_size;
-        result.push_back(analyzeSegment(segment, sample_rate));
-        segment.clear();
+        return;
     }
-    for (; curr_sample<num_samples; curr_sample++){
-        segment.push_back(channel[curr_sample]);
+
+    planSegments(channel, sample_rate, offset, segment_layout(channel.size(), segment_size*sample_rate), result, tasks);
+}
+
+// one task per (start, length) entry of layout, offset is the position of channel within the recording in seconds
+template<typename S>
+void AudioAnalyzer::planSegments(std::span<const S> channel, int sample_rate, double offset, const std::vector<std::pair<size_t, size_t>>& layout, std::vector<segment_chord>& result, std::vector<std::function<void()>>& tasks) const{
+    // the storage of the results is allocated here, the analysis itself only fills it
+    size_t largest_segment = 0;
+    result.assign(layout.size(), segment_chord());
+    for (size_t i = 0; i<layout.size(); i++){
+        result[i].notes.reserve(num_dominant);
+        largest_segment = std::max(largest_segment, layout[i].second);
     }
-    if (!segment.empty()) result.push_back(analyzeSegment(segment, sample_rate));
 
-    return result;
+    for (size_t i = 0; i<layout.size(); i++){
+        auto [start, length] = layout[i];
+        segment_chord* chord = result.data() + i;
+        tasks.emplace_back([this, channel, sample_rate, start, length, chord, offset, largest_segment](){
+            analyzeSegment(channel.subspan(start, length), sample_rate, *chord, largest_segment);
+            chord->start = offset + static_cast<double>(start)/sample_rate;
+        });
+    }
 }
 
-channel_field AudioAnalyzer::analyzeAudio(const std::string& filePath){  // frequency determines the bin width of the separately analyzed partitions of the original recording
+// segments between consecutive onsets of the channels mixed together, so that the rows of all channels stay aligned
+// the silence before the first onset forms a segment of its own (its chord stays empty)
+template<typename S>
+std::vector<std::pair<size_t, size_t>> AudioAnalyzer::onset_layout(const std::vector<std::span<const S>>& channels, int sample_rate){
+    size_t num_samples = 0;
+    for (auto&& channel : channels) num_samples = std::max(num_samples, channel.size());
+
+    ProfileTimer timer(ProfileStage::onsets, num_samples*channels.size()*sizeof(S));
+    std::vector<size_t> boundaries = detectOnsets(channels, sample_rate);
+    boundaries.push_back(num_samples);
+    std::vector<std::pair<size_t, size_t>> layout;
+    for (size_t i = 0; i+1<boundaries.size(); i++){
+        size_t start = boundaries[i], end = std::min(boundaries[i+1], num_samples);
+        if (end > start) layout.emplace_back(start, end - start);
+    }
+    return layout;
+}
+
+void AudioAnalyzer::runTasks(std::vector<std::function<void()>>& tasks) const{
+    if (pool){
+        pool->run(tasks);
+        return;
+    }
+    for (auto& task : tasks) task();
+}
 
-    WaveFile file_object(filePath);
+// short-time fourier transform - frames of segment_size seconds start every hop_size seconds
+// the last frame_length samples are kept in a ring buffer, every hop only shifts in the new samples
+// frames are zero-padded to the next fast fft size (no tiling to 4 seconds), each frame reports the hop it starts as its duration
+// analyzes the frames first_frame..first_frame+num_frames-1 of the channel into frames (start times relative to the channel)
+template<typename T, typename S>
+void AudioAnalyzer::analyzeFramesStft(std::span<const S> channel, int sample_rate, double segment_size, size_t first_frame, segment_chord* frames, size_t num_frames) const{
+    const size_t num_samples = channel.size();
+    const size_t frame_length = std::max<size_t>(1, static_cast<size_t>(std::lround(segment_size*sample_rate)));
+    const size_t hop = std::max<size_t>(1, static_cast<size_t>(std::lround(options.hop_size*sample_rate)));
+    const size_t fft_size = nextFastSize(frame_length);
+    if (num_frames == 0) return;
+
+    // per-frame buffers, taken from the workspace of the thread
+    AnalysisWorkspace<T>& workspace = AnalysisWorkspace<T>::local();
+    const std::vector<T>& window = workspace.hann(frame_length);
+    std::vector<T>& ring = workspace.samples;
+    std::vector<T>& frame = workspace.time_domain_data;
+    SpectrumScratch<T>& scratch = workspace.spectrum;
+    ring.assign(frame_length, T(0));
+    frame.assign(fft_size, T(0));
+
+    size_t next_sample = first_frame*hop; // first sample of the channel not shifted into the ring yet
+    size_t head = 0; // position of the oldest sample in the ring
+    auto shift_in = [&](size_t count){
+        if (count > frame_length){
+            next_sample += count - frame_length; // those samples would be overwritten within this hop anyway
+            count = frame_length;
+        }
+        for (size_t i = 0; i<count; i++, next_sample++){
+            ring[head] = next_sample < num_samples ? static_cast<T>(channel[next_sample]) : T(0);
+            head = head+1 == frame_length ? 0 : head+1;
+        }
+    };
+
+    shift_in(frame_length);
+    for (size_t k = 0; k<num_frames; k++){
+        ProfileTimer timer(ProfileStage::segment, frame_length*sizeof(S));
+        size_t frame_start = (first_frame + k)*hop;
+        // unrolling the ring into the windowed fft input, the zero padding after frame_length stays untouched
+        size_t first_part = frame_length - head;
+        segment_chord& chord = frames[k];
+        if (options.engine == Engine::cqt){
+            // the constant-Q kernels are windowed themselves
+            std::copy(ring.begin() + head, ring.end(), frame.begin());
+            std::copy(ring.begin(), ring.begin() + head, frame.begin() + first_part);
+            cqtNotes(frame.data(), frame_length, sample_rate, scratch, chord.notes);
+        }else{
+            {
+                ProfileTimer windowing(ProfileStage::windowing, frame_length*sizeof(T));
+                for (size_t n = 0; n<first_part; n++) frame[n] = ring[head + n]*window[n];
+                for (size_t n = first_part; n<frame_length; n++) frame[n] = ring[n - first_part]*window[n];
+            }
+            dominantNotes(frame, sample_rate, scratch, chord.notes);
+        }
+        chord.duration = static_cast<double>(std::min(hop, num_samples - frame_start))/sample_rate;
+        chord.start = static_cast<double>(frame_start)/sample_rate;
 
-    int num_channels = file_object.num_channels;
-    double sample_rate = file_object.sample_rate;
-    int num_samples = static_cast<int>(file_object.channels[0].size());  // all channels contain the same number of samples
+        shift_in(hop);
+    }
+}
+
+std::string AudioAnalyzer::parameters() const{
+    std::ostringstream oss;
+    oss.precision(17);
+    oss << "segment_size=" << frequency << " fast_fft_size=" << options.fast_fft_size << " matched_fft_size=" << options.matched_fft_size
+        << " precision=" << (options.precision == Precision::single_precision ? "float" : "double") << " hop_size=" << options.hop_size
+        << " engine=" << (options.engine == Engine::cqt ? "cqt" : "fft") << " cqt_bins_per_octave=" << options.cqt_bins_per_octave
+        << " segmentation=" << (options.segmentation == Segmentation::onsets ? "onsets" : "fixed") << " ranked=" << options.ranked_notes
+        << " channels=" << (options.channel_mode == ChannelMode::mono_mix ? "mono-mix" : options.channel_mode == ChannelMode::mid_side ? "mid-side" : "each")
+        << " duplicate_threshold=" << options.duplicate_threshold << " target_rate=" << options.target_rate
+        << " sample_storage=" << (options.sample_storage == SampleStorage::float32 ? "float" : "native");
+    return oss.str();
+}
+
+AudioAnalyzer AudioAnalyzer::ranked(int depth) const{
+    AudioAnalyzer analyzer(*this);
+    analyzer.num_dominant = depth;
+    analyzer.options.ranked_notes = true;
+    return analyzer;
+}
+
+channel_field AudioAnalyzer::analyzeAudio(const std::string& filePath) const{  // frequency determines the bin width of the separately analyzed partitions of the original recording
+
+    WaveFile file_object(filePath, options.sample_storage);
+    // one instantiation of the whole analysis per stored sample type, the segments are views of the decoded buffer
+    return file_object.samples.visit([&](const auto& channels){return analyzeChannels(channels, file_object.sample_rate);});
+}
+
+template<typename S>
+channel_field AudioAnalyzer::analyzeChannels(const std::vector<std::span<const S>>& file_channels, int file_sample_rate) const{
+    const int file_num_channels = static_cast<int>(file_channels.size());
+    int num_channels = mixedChannelCount(file_num_channels, options.channel_mode);
+    double sample_rate = file_sample_rate;
+    int num_samples = static_cast<int>(file_channels[0].size());  // all channels contain the same number of samples
     double duration = static_cast<double>(num_samples)/sample_rate;
 
-    if (frequency == 0) frequency = duration;
+    double segment_size = frequency > 0 ? frequency : duration;
+    ProfileTimer timer(ProfileStage::analysis, static_cast<uint64_t>(num_samples)*file_num_channels*sizeof(S));
 
-    channel_field channel_outputs;
+    std::vector<std::span<const S>> channels = file_channels;
+    std::vector<S> mixed;
+    if (options.channel_mode != ChannelMode::each){
+        mixed.resize(static_cast<size_t>(num_samples)*num_channels);
+        mixFrames(file_channels[0].data(), num_samples, file_num_channels, num_samples, options.channel_mode, mixed.data(), num_samples);
+        for (int i=0; i<num_channels; i++){
+            channels[i] = std::span<const S>(mixed.data() + static_cast<size_t>(i)*num_samples, num_samples);
+        }
+        channels.resize(num_channels);
+    }
+    // the notes end at about 8 kHz, the transforms of a decimated recording are several times smaller
+    const int factor = decimationFactor(file_sample_rate, options.target_rate);
+    std::vector<std::vector<S>> decimated;
+    if (factor > 1){
+        decimated.resize(num_channels);
+        vector<function<void()>> decimation_tasks;
+        for (int i=0; i<num_channels; i++){
+            decimation_tasks.emplace_back([&channels, &decimated, factor, i](){decimate(channels[i], factor, decimated[i]);});
+        }
+        runTasks(decimation_tasks);
+        for (int i=0; i<num_channels; i++) channels[i] = decimated[i];
+        sample_rate /= factor;
+    }
+    // copies of one signal (a mono recording saved as stereo) are analyzed once, near copies only when asked for
+    std::vector<int> representative = duplicateChannels(channels, options.duplicate_threshold);
+
+    // the segments of all channels are independent - they are analyzed as one batch of tasks
+    channel_field channel_outputs(num_channels);
+    vector<function<void()>> tasks;
+    if (options.segmentation == Segmentation::onsets){
+        // one full analysis per note event, the events are shared by all channels
+        auto layout = onset_layout(channels, (int)sample_rate);
+        for (int i=0; i<num_channels; i++){
+            if (representative[i] != i) continue;
+            planSegments(channels[i], (int)sample_rate, 0, layout, channel_outputs[i], tasks);
+        }
+    }else{
+        for (int i=0; i<num_channels; i++){
+            if (representative[i] != i) continue;
+            planChannel(channels[i], (int)sample_rate, segment_size, channel_outputs[i], tasks);
+        }
+    }
+    runTasks(tasks);
     for (int i=0; i<num_channels; i++){
-        channel_outputs.push_back(analyzeChannel(file_object.channels[i], (int)sample_rate));
+        if (representative[i] != i) channel_outputs[i] = channel_outputs[representative[i]];
     }
     return channel_outputs;
 
 }
 
+void AudioAnalyzer::analyzeStream(const std::string& filePath, const std::function<void(const std::vector<segment_chord>&)>& on_row) const{
+    WaveStream stream(filePath);
+
+    int file_channels = stream.format.num_channels;
+    int num_channels = mixedChannelCount(file_channels, options.channel_mode);
+    const int factor = decimationFactor(stream.format.sample_rate, options.target_rate);
+    int sample_rate = stream.format.sample_rate/factor;
+    const size_t num_frames = (stream.num_frames + factor - 1)/factor; // of the analyzed (decimated) channels
+    double window_size = frequency > 0 ? frequency*sample_rate : static_cast<double>(num_frames);
+
+    // per channel: samples received but not analyzed yet and the results waiting for the other channels of their row
+    // the segment layout is known as soon as the leading zeros of the channel are skipped
+    struct ChannelState {
+        bool started = false;
+        std::vector<std::pair<size_t, size_t>> layout;
+        size_t next_segment = 0;
+        size_t leading_zeros = 0;
+        size_t pending_start = 0; // position of pending[0] within the stripped channel
+        std::vector<int> pending;
+        std::deque<segment_chord> ready;
+    };
+    std::vector<ChannelState> states(num_channels);
+    std::vector<Decimator> decimators(factor > 1 ? num_channels : 0, Decimator(factor));
+    std::vector<std::vector<int>> decimated(decimators.size());
+
+    size_t block_frames = std::max<size_t>(1, static_cast<size_t>(std::ceil(window_size)))*factor;
+    std::vector<int> block(block_frames*file_channels);
+    std::vector<int> mixed_block(options.channel_mode == ChannelMode::each ? 0 : block_frames*num_channels);
+    std::vector<segment_chord> row(num_channels);
+
+    size_t frames_read = 0; // analyzed frames handed over so far
+    // takes the next frames of channel c, analyzing every segment they complete
+    auto consume = [&](int c, std::span<const int> samples){
+        ChannelState& state = states[c];
+        if (!state.started){
+            std::span<const int> stripped = strip_leading_zeros(samples);
+            if (stripped.empty()) return;
+            state.started = true;
+            state.leading_zeros = frames_read + (samples.size() - stripped.size());
+            state.layout = segment_layout(num_frames - state.leading_zeros, window_size);
+            samples = stripped;
+        }
+        state.pending.insert(state.pending.end(), samples.begin(), samples.end());
+
+        while (state.next_segment < state.layout.size()){
+            auto [start, length] = state.layout[state.next_segment];
+            if (start + length > state.pending_start + state.pending.size()) break;
+            auto first = state.pending.begin() + static_cast<std::ptrdiff_t>(start - state.pending_start);
+            state.ready.emplace_back();
+            analyzeSegment(std::span<const int>(state.pending).subspan(start - state.pending_start, length), sample_rate, state.ready.back());
+            state.ready.back().start = static_cast<double>(state.leading_zeros + start)/sample_rate;
+            state.next_segment++;
+
+            state.pending.erase(state.pending.begin(), first + static_cast<std::ptrdiff_t>(length));
+            state.pending_start = start + length;
+        }
+    };
+
+    size_t frames;
+    while ((frames = stream.read(block_frames, block.data())) > 0){
+        if (!mixed_block.empty()){
+            mixFrames(block.data(), block_frames, file_channels, frames, options.channel_mode, mixed_block.data(), block_frames);
+        }
+        const std::vector<int>& channel_block = mixed_block.empty() ? block : mixed_block;
+        size_t analyzed = frames;
+        for (int c = 0; c<num_channels; c++){
+            const int* samples = channel_block.data() + c*block_frames;
+            if (decimators.empty()){
+                consume(c, std::span<const int>(samples, frames));
+                continue;
+            }
+            decimated[c].clear();
+            {
+                ProfileTimer timer(ProfileStage::decimation, frames*sizeof(int));
+                decimators[c].process(samples, frames, decimated[c]);
+            }
+            analyzed = decimated[c].size(); // the same for every channel
+            consume(c, decimated[c]);
+        }
+        frames_read += analyzed;
+
+        // a row is complete once every channel has analyzed its segment
+        while (std::all_of(states.begin(), states.end(), [](const ChannelState& state){return !state.ready.empty();})){
+            for (int c = 0; c<num_channels; c++){
+                row[c] = std::move(states[c].ready.front());
+                states[c].ready.pop_front();
+            }
+            on_row(row);
+        }
+    }
+
+    // the decimation filters hold back the outputs centered on the last input samples
+    for (int c = 0; c<(int)decimators.size(); c++){
+        decimated[c].clear();
+        decimators[c].finish(decimated[c]);
+        consume(c, decimated[c]);
+    }
+    // a truncated data chunk leaves the last segment incomplete, it is analyzed with what arrived
+    for (ChannelState& state : states){
+        if (state.next_segment < state.layout.size() && !state.pending.empty()){
+            state.ready.emplace_back();
+            analyzeSegment(std::span<const int>(state.pending), sample_rate, state.ready.back());
+            state.ready.back().start = static_cast<double>(state.leading_zeros + state.pending_start)/sample_rate;
+        }
+    }
+
+    // channels can end up with different numbers of segments (different amounts of leading silence)
+    while (std::any_of(states.begin(), states.end(), [](const ChannelState& state){return !state.ready.empty();})){
+        for (int c = 0; c<num_channels; c++){
+            if (states[c].ready.empty()){
+                row[c] = segment_chord();
+                continue;
+            }
+            row[c] = std::move(states[c].ready.front());
+            states[c].ready.pop_front();
+        }
+        on_row(row);
+    }
+}
+
+LiveStats AudioAnalyzer::analyzeLive(std::FILE* input, const WaveFormat& format, bool wait_for_analysis, const std::function<void(const std::vector<segment_chord>&)>& on_row) const{
+    const DecodeKernel decode = selectDecodeKernel(format);
+    if (!decode) throw std::runtime_error("Unsupported live input format");
+    using clock = std::chrono::steady_clock;
+
+    const int file_channels = format.num_channels;
+    const int num_channels = mixedChannelCount(file_channels, options.channel_mode);
+    const int sample_rate = format.sample_rate;
+    const size_t frame_bytes = format.frame_bytes();
+    const double hop_seconds = frequency > 0 ? frequency : 0.1;
+    const uint64_t hop = std::max<uint64_t>(1, static_cast<uint64_t>(std::llround(hop_seconds*sample_rate)));
+    // the longest window covers a whole row, at least a quarter of a second for the resolution of the low octaves
+    const size_t max_window = std::max<size_t>(hop, sample_rate/4);
+
+    // chunks of a few milliseconds, the ring holds about two seconds of input
+    constexpr size_t chunk_frames = 256;
+    struct Chunk {
+        std::vector<uint8_t> bytes;
+        size_t frames = 0;
+        uint64_t first_frame = 0; // position within the input, frames dropped before it leave a gap
+        clock::time_point arrival;
+    };
+    // shared with the reader, which may outlive this call when the analysis fails (it stops at the end of the input only)
+    struct Shared {
+        SpscRing<Chunk> ring;
+        std::atomic<bool> finished{false};
+        std::atomic<uint64_t> dropped{0};
+        uint64_t total_frames = 0; // published by finished
+        Shared(size_t capacity, const Chunk& prototype) : ring(capacity, prototype){}
+    };
+    Chunk prototype;
+    prototype.bytes.resize(chunk_frames*frame_bytes);
+    auto shared = std::make_shared<Shared>(std::max<size_t>(4, 2*sample_rate/chunk_frames), prototype);
+    SpscRing<Chunk>& ring = shared->ring;
+
+    std::thread reader([shared, input, frame_bytes, wait_for_analysis](){
+        SpscRing<Chunk>& ring = shared->ring;
+        std::vector<uint8_t> buffer(chunk_frames*frame_bytes);
+        size_t filled = 0;
+        uint64_t frame = 0;
+        while (true){
+#ifdef AUDIO_TRANSCRIBER_HAS_POSIX_READ
+            ssize_t got = ::read(fileno(input), buffer.data() + filled, buffer.size() - filled); // whatever has arrived
+            if (got < 0 && errno == EINTR) continue;
+            if (got <= 0) break;
+#else
+            size_t got = std::fread(buffer.data() + filled, 1, buffer.size() - filled, input);
+            if (got == 0) break;
+#endif
+            filled += static_cast<size_t>(got);
+            const size_t frames = filled/frame_bytes;
+            if (frames == 0) continue;
+
+            Chunk* chunk = ring.write_slot();
+            while (!chunk && wait_for_analysis){
+                std::this_thread::yield();
+                chunk = ring.write_slot();
+            }
+            if (chunk){
+                std::memcpy(chunk->bytes.data(), buffer.data(), frames*frame_bytes);
+                chunk->frames = frames;
+                chunk->first_frame = frame;
+                chunk->arrival = clock::now();
+                ring.push();
+            }else{
+                shared->dropped.fetch_add(frames, std::memory_order_relaxed);
+            }
+            frame += frames;
+            filled -= frames*frame_bytes;
+            std::memmove(buffer.data(), buffer.data() + frames*frame_bytes, filled); // an incomplete frame waits for the rest
+        }
+        shared->total_frames = frame;
+        shared->finished.store(true, std::memory_order_release);
+    });
+
+    // the full scale of the decoded samples, quieter pitches than -60 dB of it are not reported
+    const double full_scale = format.audio_format == 3 ? 8388607.0 : std::ldexp(1.0, format.bits_per_sample - 1);
+    const double floor = full_scale*full_scale*1e-6/4;
+    const size_t k = static_cast<size_t>(std::clamp(num_dominant, 0, NUM_NOTES));
+
+    std::vector<SlidingNoteBank> banks(num_channels, SlidingNoteBank(sample_rate, max_window));
+    std::vector<int> block(chunk_frames*file_channels);
+    std::vector<int> mixed_block(options.channel_mode == ChannelMode::each ? 0 : chunk_frames*num_channels);
+    std::vector<segment_chord> row(num_channels);
+    std::array<double, NUM_NOTES> power;
+    std::vector<int> candidates;
+    candidates.reserve(NUM_NOTES);
+
+    LiveStats stats;
+    double latency_sum = 0;
+    uint64_t measured_rows = 0;
+    uint64_t position = 0;
+    uint64_t next_row = hop;
+    clock::time_point last_arrival;
+
+    // the strongest local maxima of the pitch powers (a pitch louder than both neighbours), ordered by frequency
+    // the row covers the input from next_row - hop up to end
+    auto emit = [&](bool empty, clock::time_point arrival, uint64_t end){
+        for (int c = 0; c<num_channels; c++){
+            segment_chord& chord = row[c];
+            chord.notes.clear();
+            chord.start = static_cast<double>(next_row - hop)/sample_rate;
+            chord.duration = static_cast<double>(end - (next_row - hop))/sample_rate;
+            if (empty) continue;
+
+            ProfileTimer peaks_timer(ProfileStage::peaks);
+            banks[c].power(power);
+            double strongest = *std::max_element(power.begin(), power.end());
+            candidates.clear();
+            for (int i = 0; i<NUM_NOTES; i++){
+                if (power[i] < floor || power[i] < strongest*1e-3) continue;
+                if ((i > 0 && power[i] < power[i-1]) || (i+1 < NUM_NOTES && power[i] <= power[i+1])) continue;
+                candidates.push_back(i);
+            }
+            size_t count = std::min(k, candidates.size());
+            std::partial_sort(candidates.begin(), candidates.begin() + count, candidates.end(), [&](int a, int b){return power[a] > power[b];});
+            std::sort(candidates.begin(), candidates.begin() + count);
+            for (size_t i = 0; i<count; i++) chord.notes.emplace_back(NoteClassifier::table[candidates[i]]);
+        }
+        on_row(row);
+        stats.rows++;
+        if (!empty){
+            double latency = std::chrono::duration<double>(clock::now() - arrival).count();
+            latency_sum += latency;
+            measured_rows++;
+            stats.max_latency = std::max(stats.max_latency, latency);
+        }
+        next_row += hop;
+    };
+
+    try {
+        while (true){
+            Chunk* chunk = ring.front();
+            if (!chunk){
+                if (shared->finished.load(std::memory_order_acquire) && !(chunk = ring.front())) break;
+                if (!chunk){
+                    std::this_thread::sleep_for(std::chrono::microseconds(100));
+                    continue;
+                }
+            }
+
+            // rows that ended within dropped input are reported without notes
+            while (next_row <= chunk->first_frame) emit(true, chunk->arrival, next_row);
+            position = chunk->first_frame;
+
+            {
+                ProfileTimer decode_timer(ProfileStage::decode, chunk->frames*frame_bytes);
+                decode(chunk->bytes.data(), chunk->frames, file_channels, block.data(), chunk_frames);
+                if (!mixed_block.empty()){
+                    mixFrames(block.data(), chunk_frames, file_channels, chunk->frames, options.channel_mode, mixed_block.data(), chunk_frames);
+                }
+            }
+            const int* samples = mixed_block.empty() ? block.data() : mixed_block.data();
+
+            size_t done = 0;
+            while (done < chunk->frames){
+                size_t n = static_cast<size_t>(std::min<uint64_t>(chunk->frames - done, next_row - position));
+                {
+                    ProfileTimer analysis_timer(ProfileStage::analysis, static_cast<uint64_t>(n)*num_channels*sizeof(int));
+                    for (int c = 0; c<num_channels; c++) banks[c].process(samples + c*chunk_frames + done, n);
+                }
+                done += n;
+                position += n;
+                if (position == next_row) emit(false, chunk->arrival, next_row);
+            }
+            stats.frames += chunk->frames;
+            last_arrival = chunk->arrival;
+            ring.pop();
+        }
+        // input dropped at the end leaves rows without notes, like a gap
+        const uint64_t total_frames = shared->total_frames;
+        if (total_frames > position){
+            while (next_row <= total_frames) emit(true, last_arrival, next_row);
+            if (total_frames > next_row - hop) emit(true, last_arrival, total_frames);
+        }else if (position > next_row - hop){
+            emit(false, last_arrival, position); // the incomplete last row
+        }
+    }catch(...){
+        reader.detach(); // a failure is reported right away instead of at the end of the input
+        throw;
+    }
+    reader.join();
+
+    stats.dropped_frames = shared->dropped.load(std::memory_order_relaxed);
+    stats.mean_latency = measured_rows > 0 ? latency_sum/static_cast<double>(measured_rows) : 0;
+    return stats;
+}
+
 
 #endif //AUDIO_TRANSCRIBER_AUDIO_ANALYSIS_H
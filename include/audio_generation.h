@@ -13,8 +13,8 @@
 #include "wav_creation.h"
 
 
-void generateAudio(const std::string& outputFilePath, std::vector<channel_type> chords){
-    WaveGener wave_generator(std::move(chords));
+void generateAudio(const std::string& outputFilePath, std::vector<channel_type> chords, AudioOutputOptions options = AudioOutputOptions()){
+    WaveGener wave_generator(std::move(chords), options);
     wave_generator.write_to_file(outputFilePath);
 }
 
@@ -0,0 +1,104 @@
+//
+// Created by Samuel Longauer on 17/10/2026.
+//
+
+#ifndef PROJECT_CHANNEL_LAYOUT_H
+#define PROJECT_CHANNEL_LAYOUT_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <span>
+#include <stdexcept>
+#include <type_traits>
+#include <vector>
+
+// which signals are analyzed: every channel of the file, their average (one channel), or the mid (average) and side
+// (half difference) of a stereo file
+enum class ChannelMode {each, mono_mix, mid_side};
+
+// number of analyzed channels for a file with num_channels channels, throws std::runtime_error when the mode does not apply
+int mixedChannelCount(int num_channels, ChannelMode mode){
+    switch (mode){
+        case ChannelMode::each: return num_channels;
+        case ChannelMode::mono_mix: return 1;
+        case ChannelMode::mid_side:
+            if (num_channels != 2) throw std::runtime_error("--channels mid-side needs a stereo recording");
+            return 2;
+    }
+    return num_channels;
+}
+
+// mixes frames of planar input (channel c starts at in + c*in_stride) into planar output with mixedChannelCount channels
+// integer samples are summed in int64_t, float samples in double
+template<typename S>
+void mixFrames(const S* in, size_t in_stride, int num_channels, size_t frames, ChannelMode mode, S* out, size_t out_stride){
+    using Wide = std::conditional_t<std::is_integral_v<S>, int64_t, double>;
+    if (mode == ChannelMode::each){
+        for (int c = 0; c<num_channels; c++){
+            std::copy(in + c*in_stride, in + c*in_stride + frames, out + c*out_stride);
+        }
+        return;
+    }
+    if (mode == ChannelMode::mid_side){
+        const S* left = in;
+        const S* right = in + in_stride;
+        for (size_t i = 0; i<frames; i++){
+            Wide l = left[i], r = right[i];
+            out[i] = static_cast<S>((l + r)/2);
+            out[out_stride + i] = static_cast<S>((l - r)/2);
+        }
+        return;
+    }
+    for (size_t i = 0; i<frames; i++){
+        Wide sum = 0;
+        for (int c = 0; c<num_channels; c++) sum += in[c*in_stride + i];
+        out[i] = static_cast<S>(sum/num_channels);
+    }
+}
+
+// for every channel the index of the channel whose analysis it can reuse (itself when none)
+// bit-identical channels are always merged, others when the normalized correlation of their samples reaches threshold
+// and their first non-zero sample is the same (the timing of the segments follows it), a threshold above 1 only merges
+// identical channels; a single pass over each pair, far cheaper than analyzing a channel
+// the correlation ignores the scale and barely notices a quiet partial of one channel, so it is opt-in
+template<typename S>
+std::vector<int> duplicateChannels(const std::vector<std::span<const S>>& channels, double threshold){
+    std::vector<int> representative(channels.size());
+    std::vector<int> unique; // channels analyzed on their own
+    std::vector<size_t> first_sample(channels.size()); // offset of the first non-zero sample
+    for (size_t c = 0; c<channels.size(); c++){
+        auto first = std::find_if(channels[c].begin(), channels[c].end(), [](S x){return x != S(0);});
+        first_sample[c] = static_cast<size_t>(first - channels[c].begin());
+    }
+    for (size_t c = 0; c<channels.size(); c++){
+        representative[c] = static_cast<int>(c);
+        std::span<const S> channel = channels[c];
+        for (int u : unique){
+            std::span<const S> other = channels[u];
+            if (other.size() != channel.size()) continue;
+            if (std::equal(channel.begin(), channel.end(), other.begin())){
+                representative[c] = u;
+                break;
+            }
+            if (threshold > 1) continue;
+            if (first_sample[c] != first_sample[u]) continue;
+
+            double xy = 0, xx = 0, yy = 0;
+            for (size_t i = 0; i<channel.size(); i++){
+                double x = channel[i], y = other[i];
+                xy += x*y;
+                xx += x*x;
+                yy += y*y;
+            }
+            if (xx > 0 && yy > 0 && xy/std::sqrt(xx*yy) >= threshold){
+                representative[c] = u;
+                break;
+            }
+        }
+        if (representative[c] == static_cast<int>(c)) unique.push_back(static_cast<int>(c));
+    }
+    return representative;
+}
+
+#endif //PROJECT_CHANNEL_LAYOUT_H
@@ -0,0 +1,217 @@
+//
+// Created by Samuel Longauer on 17/10/2026.
+//
+
+#ifndef PROJECT_CQT_H
+#define PROJECT_CQT_H
+
+#include <cmath>
+#include <complex>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <vector>
+#include "dft.h"
+
+// buffers of one constant-Q analysis, reused across calls by the owner
+template<typename T>
+struct CqtScratch {
+    std::vector<T> signal; // the input at the rate of the current octave
+    std::vector<T> decimated;
+    std::vector<T> frame;
+    std::vector<std::complex<T>> spectrum;
+};
+
+// constant-Q transform over the equal-tempered pitches starting at C0, with one bin per semitone (12 bins per octave)
+// or per quarter tone (24), following Brown and Puckette's sparse spectral kernels:
+// the kernels are only built for the highest analyzed octave, every lower octave reuses them on the input
+// decimated by two once more, so each octave costs half of the one above it
+template<typename T>
+class ConstantQTransform {
+public:
+    static constexpr double C0 = 16.351597831287414; // 440 Hz * 2^(-57/12)
+    static constexpr int max_octaves = 9; // C0..B8, the range of NoteClassifier
+
+    ConstantQTransform(int sample_rate, int bins_per_octave);
+    // shared instance for the given parameters, built on first use
+    static const ConstantQTransform& get(int sample_rate, int bins_per_octave);
+
+    int bins_per_octave() const {return bins_per_octave_;}
+    size_t num_bins() const {return static_cast<size_t>(num_octaves_)*bins_per_octave_;}
+    double frequency(size_t bin) const {return C0*std::pow(2.0, static_cast<double>(bin)/bins_per_octave_);}
+
+    // mean power of every bin over the frames covering samples, power[b] belongs to frequency(b)
+    // octaves above 0.45 of the sample rate are left out, so num_bins() can be less than max_octaves*bins_per_octave
+    void powers(const T* samples, size_t num_samples, std::vector<T>& power, CqtScratch<T>& scratch) const;
+
+private:
+    struct SparseKernel {
+        std::vector<uint32_t> index; // bins of the frame spectrum
+        std::vector<std::complex<T>> weight; // conjugated and scaled kernel spectrum at those bins
+    };
+
+    int sample_rate_;
+    int bins_per_octave_;
+    int num_octaves_ = 0; // the highest analyzed octave is num_octaves_-1 and runs at the full sample rate
+    size_t fft_size_ = 0;
+    size_t hop_ = 0; // frame distance, the length of the shortest kernel so that every kernel covers the whole input
+    std::vector<SparseKernel> kernels_; // bins_per_octave_ kernels of the highest analyzed octave
+    std::vector<std::pair<int, T>> decimation_taps_; // (offset from the output position, coefficient), the zero taps are left out
+
+    void decimate_(const std::vector<T>& in, std::vector<T>& out) const;
+};
+
+template<typename T>
+ConstantQTransform<T>::ConstantQTransform(int sample_rate, int bins_per_octave) : sample_rate_(sample_rate), bins_per_octave_(bins_per_octave){
+    // the highest octave whose top edge stays below 0.45 fs, the rest of the band is left to the anti-aliasing filter
+    while (num_octaves_ < max_octaves && C0*std::pow(2.0, num_octaves_ + 1) <= 0.45*sample_rate) num_octaves_++;
+    if (num_octaves_ == 0) return;
+
+    const double Q = 1.0/(std::pow(2.0, 1.0/bins_per_octave) - 1);
+    const double top_octave_base = C0*std::pow(2.0, num_octaves_ - 1);
+
+    std::vector<size_t> lengths(bins_per_octave);
+    for (int k = 0; k<bins_per_octave; k++){
+        double f = top_octave_base*std::pow(2.0, static_cast<double>(k)/bins_per_octave);
+        lengths[k] = static_cast<size_t>(std::ceil(Q*sample_rate/f));
+    }
+    fft_size_ = 1;
+    while (fft_size_ < lengths[0]) fft_size_ *= 2;
+    hop_ = lengths[bins_per_octave - 1];
+
+    // temporal kernels (Hann windowed complex exponentials normalized by their length) centered in the frame,
+    // transformed once, only the coefficients above 1% of the peak are kept
+    const std::shared_ptr<const FFTPlan> plan = FFTPlan::get(fft_size_);
+    std::vector<std::complex<double>> kernel(fft_size_);
+    for (int k = 0; k<bins_per_octave; k++){
+        double f = top_octave_base*std::pow(2.0, static_cast<double>(k)/bins_per_octave);
+        size_t length = lengths[k];
+        size_t offset = (fft_size_ - length)/2;
+        std::fill(kernel.begin(), kernel.end(), std::complex<double>(0, 0));
+        for (size_t n = 0; n<length; n++){
+            double window = 0.5 - 0.5*std::cos(2*M_PI*(n + 0.5)/length);
+            double phase = 2*M_PI*f*(static_cast<double>(n) - length/2.0)/sample_rate;
+            kernel[offset + n] = std::polar(window/length, phase);
+        }
+        plan->forward(kernel.data());
+
+        // the input is real, so only the positive frequencies of its spectrum are available - the kernel is analytic anyway
+        double peak = 0;
+        for (size_t j = 0; j<=fft_size_/2; j++) peak = std::max(peak, std::abs(kernel[j]));
+        SparseKernel sparse;
+        for (size_t j = 0; j<=fft_size_/2; j++){
+            if (std::abs(kernel[j]) < 0.01*peak) continue;
+            sparse.index.push_back(static_cast<uint32_t>(j));
+            std::complex<double> w = std::conj(kernel[j])/static_cast<double>(fft_size_);
+            sparse.weight.emplace_back(static_cast<T>(w.real()), static_cast<T>(w.imag()));
+        }
+        kernels_.push_back(std::move(sparse));
+    }
+
+    // blackman windowed sinc with the cutoff at half of the band - the next octave ends at 0.225 of the current rate,
+    // the stop band starts where the decimated spectrum would fold back onto it
+    // a half-band filter has every second tap zero besides the center one, those are skipped
+    constexpr int taps = 63;
+    constexpr int half = (taps - 1)/2;
+    double sum = 0;
+    std::vector<std::pair<int, double>> h;
+    for (int t = 0; t<taps; t++){
+        int x = t - half;
+        if (x != 0 && x%2 == 0) continue;
+        double sinc = x == 0 ? 0.5 : std::sin(M_PI*x/2)/(M_PI*x);
+        double window = 0.42 - 0.5*std::cos(2*M_PI*t/(taps - 1)) + 0.08*std::cos(4*M_PI*t/(taps - 1));
+        h.emplace_back(x, sinc*window);
+        sum += sinc*window;
+    }
+    for (auto [offset, coefficient] : h) decimation_taps_.emplace_back(offset, static_cast<T>(coefficient/sum));
+}
+
+template<typename T>
+const ConstantQTransform<T>& ConstantQTransform<T>::get(int sample_rate, int bins_per_octave){
+    static std::mutex cache_mutex;
+    static std::map<std::pair<int, int>, std::unique_ptr<ConstantQTransform>> cache;
+    std::pair<int, int> key(sample_rate, bins_per_octave);
+
+    {
+        std::lock_guard<std::mutex> lock(cache_mutex);
+        auto it = cache.find(key);
+        if (it != cache.end()) return *it->second;
+    }
+
+    // building outside of the lock, the kernels request an fft plan
+    auto transform = std::make_unique<ConstantQTransform>(sample_rate, bins_per_octave);
+    std::lock_guard<std::mutex> lock(cache_mutex);
+    auto& entry = cache[key];
+    if (!entry) entry = std::move(transform);
+    return *entry;
+}
+
+// low-pass filtering and keeping every second sample, only the kept outputs are computed
+template<typename T>
+void ConstantQTransform<T>::decimate_(const std::vector<T>& in, std::vector<T>& out) const{
+    const long length = static_cast<long>(in.size());
+    const long reach = decimation_taps_.empty() ? 0 : -decimation_taps_.front().first;
+    out.resize((in.size() + 1)/2);
+    for (long m = 0; m<static_cast<long>(out.size()); m++){
+        long position = 2*m;
+        T acc = 0;
+        if (position >= reach && position + reach < length){
+            for (const auto& [offset, coefficient] : decimation_taps_) acc += coefficient*in[position + offset];
+        }else{
+            // zero padding at the edges of the input
+            for (const auto& [offset, coefficient] : decimation_taps_){
+                long i = position + offset;
+                if (i >= 0 && i < length) acc += coefficient*in[i];
+            }
+        }
+        out[m] = acc;
+    }
+}
+
+template<typename T>
+void ConstantQTransform<T>::powers(const T* samples, size_t num_samples, std::vector<T>& power, CqtScratch<T>& scratch) const{
+    power.assign(num_bins(), T(0));
+    if (num_octaves_ == 0 || num_samples == 0) return;
+
+    const std::shared_ptr<const BasicFFTPlan<T>> plan = BasicFFTPlan<T>::get(fft_size_);
+    scratch.signal.assign(samples, samples + num_samples);
+    scratch.frame.resize(fft_size_);
+    scratch.spectrum.resize(fft_size_/2 + 1);
+
+    for (int octave = num_octaves_ - 1; octave>=0; octave--){
+        const std::vector<T>& signal = scratch.signal;
+        const size_t length = signal.size();
+        T* octave_power = power.data() + static_cast<size_t>(octave)*bins_per_octave_;
+
+        // frames centered at hop/2, hop/2 + hop, ... (a single frame in the middle of a short input)
+        size_t num_frames = std::max<size_t>(1, (length + hop_ - 1)/hop_);
+        for (size_t m = 0; m<num_frames; m++){
+            long center = num_frames == 1 ? static_cast<long>(length/2) : static_cast<long>(hop_/2 + m*hop_);
+            long first = center - static_cast<long>(fft_size_/2);
+            for (size_t n = 0; n<fft_size_; n++){
+                long i = first + static_cast<long>(n);
+                scratch.frame[n] = (i >= 0 && i < static_cast<long>(length)) ? signal[i] : T(0);
+            }
+            plan->forwardReal(scratch.frame.data(), scratch.spectrum.data());
+
+            for (int k = 0; k<bins_per_octave_; k++){
+                const SparseKernel& kernel = kernels_[k];
+                std::complex<T> coefficient(0, 0);
+                for (size_t j = 0; j<kernel.index.size(); j++){
+                    coefficient += scratch.spectrum[kernel.index[j]]*kernel.weight[j];
+                }
+                octave_power[k] += std::norm(coefficient);
+            }
+        }
+        for (int k = 0; k<bins_per_octave_; k++) octave_power[k] /= static_cast<T>(num_frames);
+
+        if (octave > 0){
+            decimate_(scratch.signal, scratch.decimated);
+            std::swap(scratch.signal, scratch.decimated);
+        }
+    }
+}
+
+#endif //PROJECT_CQT_H
@@ -0,0 +1,132 @@
+//
+// Created by Samuel Longauer on 17/10/2026.
+//
+
+#ifndef PROJECT_DECIMATION_H
+#define PROJECT_DECIMATION_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <numbers>
+#include <type_traits>
+#include <vector>
+#include <span>
+#include "simd_kernels.h"
+#include "profiler.h"
+
+// the integer decimation factor that brings sample_rate down to about target_rate - the largest divisor of the rate
+// not above their ratio, so that the decimated rate stays a whole number (1 when target_rate is 0 or not lower)
+int decimationFactor(int sample_rate, int target_rate){
+    if (target_rate <= 0 || target_rate >= sample_rate) return 1;
+    for (int factor = sample_rate/target_rate; factor > 1; factor--){
+        if (sample_rate % factor == 0) return factor;
+    }
+    return 1;
+}
+
+// anti-aliasing low-pass filter and downsampler by an integer factor, fed block by block
+// only the kept outputs are computed (the polyphase form - no filtered sample is thrown away), each one is a single
+// dot product of the taps with the input around it; the filter is linear-phase and centered, so output n is aligned
+// with input n*factor and the input of length n yields ceil(n/factor) outputs once finish() is called
+// the Blackman-windowed sinc passes up to about 0.4 of the output rate and stops everything above about 0.48 of it
+class Decimator {
+public:
+    explicit Decimator(int factor);
+
+    int factor() const {return factor_;}
+    // appends the outputs that the next count input samples complete (integer outputs are rounded and clipped to S)
+    template<typename S>
+    void process(const S* in, size_t count, std::vector<S>& out);
+    // appends the outputs still waiting for the samples after the end of the input
+    template<typename S>
+    void finish(std::vector<S>& out);
+
+private:
+    int factor_;
+    size_t half_; // taps on each side of the center
+    std::vector<double> taps_;
+    std::vector<double> buffer_; // the input from index base_ on (the samples before the beginning are zeros)
+    int64_t base_;
+    uint64_t received_ = 0;
+    uint64_t next_output_ = 0;
+
+    template<typename S>
+    void emit(uint64_t available, uint64_t limit, std::vector<S>& out);
+};
+
+Decimator::Decimator(int factor) : factor_(std::max(factor, 1)){
+    half_ = 32*static_cast<size_t>(factor_);
+    const size_t length = 2*half_ + 1;
+    const double cutoff = 0.44/factor_; // relative to the input rate, the transition band is centered on it
+    taps_.resize(length);
+    double sum = 0;
+    for (size_t i = 0; i<length; i++){
+        const double t = static_cast<double>(i) - static_cast<double>(half_);
+        const double sinc = t == 0 ? 2*cutoff : std::sin(2*std::numbers::pi*cutoff*t)/(std::numbers::pi*t);
+        const double phase = 2*std::numbers::pi*static_cast<double>(i)/static_cast<double>(length - 1);
+        const double window = 0.42 - 0.5*std::cos(phase) + 0.08*std::cos(2*phase);
+        taps_[i] = sinc*window;
+        sum += taps_[i];
+    }
+    for (double& tap : taps_) tap /= sum; // unity gain at 0 Hz
+    buffer_.assign(half_, 0.0);
+    base_ = -static_cast<int64_t>(half_);
+}
+
+template<typename S>
+void Decimator::process(const S* in, size_t count, std::vector<S>& out){
+    buffer_.insert(buffer_.end(), in, in + count);
+    received_ += count;
+    emit(received_, received_, out);
+}
+
+template<typename S>
+void Decimator::finish(std::vector<S>& out){
+    const uint64_t total = received_;
+    buffer_.resize(buffer_.size() + half_, 0.0);
+    emit(total + half_, total, out);
+}
+
+// output n needs the input n*factor - half .. n*factor + half, only outputs of inputs before limit are produced
+template<typename S>
+void Decimator::emit(uint64_t available, uint64_t limit, std::vector<S>& out){
+    const SpectralKernels<double>& kernels = SpectralKernels<double>::get();
+    while (true){
+        const uint64_t center = next_output_*factor_;
+        if (center >= limit || center + half_ >= available) break;
+        const double* window = buffer_.data() + (static_cast<int64_t>(center) - static_cast<int64_t>(half_) - base_);
+        const double value = kernels.dot(taps_.data(), window, taps_.size());
+        if constexpr (std::is_integral_v<S>){
+            constexpr double low = std::numeric_limits<S>::min(), high = std::numeric_limits<S>::max();
+            out.push_back(static_cast<S>(std::lrint(std::clamp(value, low, high))));
+        }else{
+            out.push_back(static_cast<S>(value));
+        }
+        next_output_++;
+    }
+    // the input the next output starts from stays, everything before it is dropped
+    const int64_t keep_from = static_cast<int64_t>(next_output_*factor_) - static_cast<int64_t>(half_);
+    if (keep_from > base_){
+        const size_t drop = std::min(buffer_.size(), static_cast<size_t>(keep_from - base_));
+        buffer_.erase(buffer_.begin(), buffer_.begin() + static_cast<std::ptrdiff_t>(drop));
+        base_ += static_cast<int64_t>(drop);
+    }
+}
+
+// a whole channel decimated into out, fed in blocks so that the filter buffer stays small
+template<typename S>
+void decimate(std::span<const S> in, int factor, std::vector<S>& out){
+    ProfileTimer timer(ProfileStage::decimation, in.size_bytes());
+    constexpr size_t block = 1 << 16;
+    Decimator decimator(factor);
+    out.clear();
+    out.reserve((in.size() + factor - 1)/factor);
+    for (size_t i = 0; i<in.size(); i += block){
+        decimator.process(in.data() + i, std::min(block, in.size() - i), out);
+    }
+    decimator.finish(out);
+}
+
+#endif //PROJECT_DECIMATION_H
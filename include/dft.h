@@ -10,42 +10,477 @@
 #include <complex>
 #include <fstream>
 #include <cmath>
+#include <cstdint>
+#include <algorithm>
+#include <map>
+#include <memory>
+#include <mutex>
+#include "simd_kernels.h"
+#include "profiler.h"
 
 typedef std::vector<std::complex<double>> cmplx_field;
 
-cmplx_field FFT(cmplx_field & x) {
-    int N = x.size();
-    if (N <= 1) return x;
+// smallest length >= n that factors into 2, 3, 5 and 7 only (sizes the mixed-radix transform handles directly)
+size_t nextFastSize(size_t n){
+    if (n <= 1) return 1;
+    size_t best = SIZE_MAX;
+    for (size_t p7 = 1; p7<best; p7*=7){
+        for (size_t p5 = p7; p5<best; p5*=5){
+            for (size_t p3 = p5; p3<best; p3*=3){
+                size_t candidate = p3;
+                while (candidate < n) candidate *= 2;
+                best = std::min(best, candidate);
+                if (p3 >= n) break;
+            }
+            if (p5 >= n) break;
+        }
+        if (p7 >= n) break;
+    }
+    return best;
+}
+
+// per-thread work buffers for the transforms, grown on first use so that repeated transforms do not allocate
+template<typename T>
+std::complex<T>* fftScratch(int slot, size_t n){
+    static thread_local std::vector<std::complex<T>> buffers[3];
+    if (buffers[slot].size() < n) buffers[slot].resize(n);
+    return buffers[slot].data();
+}
+
+// precomputed tables for an N-point transform, the algorithm is selected by the size:
+// - powers of two run an iterative in-place radix-2 transform
+// - sizes factoring into 2, 3, 5 and 7 run a mixed-radix (Stockham) transform
+// - anything else runs Bluestein's algorithm on top of a power of two sized plan
+// plans are built once per size and shared through get(), transforms do not allocate after warm-up
+// T is the precision of the transform (double or float), the tables are always computed in double
+template<typename T>
+class BasicFFTPlan {
+public:
+    typedef std::complex<T> complex_type;
+    enum class Algorithm {radix2, mixed_radix, bluestein};
+
+    explicit BasicFFTPlan(size_t N);
+    // shared plan of length N, the caller keeps it alive while using it even if the cache drops it meanwhile
+    static std::shared_ptr<const BasicFFTPlan> get(size_t N);
+    // the cache keeps the most recently used plans up to this many bytes (the plans still in use not counted)
+    static void set_cache_limit(size_t bytes);
+    static size_t cache_bytes();
+
+    size_t size() const {return N_;}
+    Algorithm algorithm() const {return algorithm_;}
+    void forward(complex_type* data) const;
+    void inverse(complex_type* data) const;
+    // real-input transform of N samples, writes only the non-redundant bins 0..N/2 (N/2+1 values) into out
+    void forwardReal(const T* in, complex_type* out) const;
+    const std::vector<T>& hannWindow() const; // Hann window of length N, computed on first use
+    size_t size_bytes() const; // tables of the plan, including the ones built on first use
+
+private:
+    struct Stage {
+        size_t radix;
+        size_t m; // length of the sub-transforms after this stage
+        size_t stride;
+        size_t twiddle_offset;
+    };
+
+    size_t N_;
+    Algorithm algorithm_;
+    const SpectralKernels<T>& kernels_ = SpectralKernels<T>::get();
+
+    // radix-2
+    std::vector<uint32_t> bit_reversal_;
+    std::vector<complex_type> twiddles_; // twiddles of the stage with span len are stored from offset len/2-1
+
+    // mixed-radix
+    std::vector<Stage> stages_;
+    std::vector<complex_type> stage_twiddles_;
+
+    // bluestein
+    std::shared_ptr<const BasicFFTPlan> conv_plan_;
+    std::vector<complex_type> chirp_;
+    std::vector<complex_type> chirp_spectrum_; // already scaled by 1/M for the inverse transform
 
-    cmplx_field even(N/2), odd(N/2);
-    for (int i = 0; i < N/2; ++i) {
-        even[i] = x[i*2];
-        odd[i] = x[i*2 + 1];
+    mutable std::vector<T> window_;
+    mutable std::once_flag window_once_;
+
+    // the real transform runs as an N/2-point complex one followed by a split step with these twiddles
+    mutable std::shared_ptr<const BasicFFTPlan> half_plan_;
+    mutable std::vector<complex_type> real_twiddles_;
+    mutable std::once_flag real_once_;
+
+    static complex_type root_(double numerator, double denominator){
+        return complex_type(std::polar(1.0, -2 * M_PI * numerator / denominator));
     }
+    void build_radix2_();
+    bool build_mixed_radix_();
+    void build_bluestein_();
+    void radix2_(complex_type* data) const;
+    void mixed_radix_(complex_type* data) const;
+    void bluestein_(complex_type* data) const;
 
-    even = FFT(even);
-    odd = FFT(odd);
+    struct CacheEntry {
+        std::shared_ptr<const BasicFFTPlan> plan;
+        size_t bytes;
+        uint64_t last_use;
+    };
+    struct Cache {
+        std::mutex mutex;
+        std::map<size_t, CacheEntry> entries;
+        size_t bytes = 0;
+        size_t limit = size_t(64) << 20;
+        uint64_t clock = 0;
+        void evict_(size_t keep);
+    };
+    static Cache& cache_();
+};
 
-    cmplx_field result(N);
-    for (int k = 0; k < N/2; ++k) {
-        std::complex<double> t = std::polar(1.0, -2 * M_PI * k / N) * odd[k];
-        result[k] = even[k] + t;
-        result[k + N/2] = even[k] - t;
+typedef BasicFFTPlan<double> FFTPlan;
+
+template<typename T>
+BasicFFTPlan<T>::BasicFFTPlan(size_t N) : N_(N){
+    if (N <= 1 || (N & (N-1)) == 0){
+        algorithm_ = Algorithm::radix2;
+        build_radix2_();
+    }else if (build_mixed_radix_()){
+        algorithm_ = Algorithm::mixed_radix;
+    }else{
+        algorithm_ = Algorithm::bluestein;
+        build_bluestein_();
     }
-    return result;
 }
 
-cmplx_field IFFT(cmplx_field & x) {
-    for (auto& val : x) {
-        val = std::conj(val);
+template<typename T>
+void BasicFFTPlan<T>::build_radix2_(){
+    int bits = 0;
+    while ((size_t(1) << bits) < N_) bits++;
+    bit_reversal_.resize(N_);
+    for (size_t i = 0; i<N_; i++){
+        uint32_t rev = 0;
+        for (int b = 0; b<bits; b++){
+            if (i & (size_t(1) << b)) rev |= uint32_t(1) << (bits-1-b);
+        }
+        bit_reversal_[i] = rev;
+    }
+
+    twiddles_.reserve(N_ > 1 ? N_-1 : 0);
+    for (size_t len = 2; len<=N_; len<<=1){
+        for (size_t k = 0; k<len/2; k++){
+            twiddles_.push_back(root_(static_cast<double>(k), static_cast<double>(len)));
+        }
+    }
+}
+
+template<typename T>
+bool BasicFFTPlan<T>::build_mixed_radix_(){
+    std::vector<size_t> factors;
+    size_t rest = N_;
+    while (rest%4 == 0){ factors.push_back(4); rest/=4; }
+    for (size_t p : {2, 3, 5, 7}){
+        while (rest%p == 0){ factors.push_back(p); rest/=p; }
+    }
+    if (rest != 1) return false;
+
+    size_t n = N_;
+    size_t stride = 1;
+    for (size_t p : factors){
+        size_t m = n/p;
+        stages_.push_back({p, m, stride, stage_twiddles_.size()});
+        for (size_t q = 0; q<m; q++){
+            for (size_t k = 1; k<p; k++){
+                stage_twiddles_.push_back(root_(static_cast<double>(k*q), static_cast<double>(n)));
+            }
+        }
+        n = m;
+        stride *= p;
+    }
+    return true;
+}
+
+template<typename T>
+void BasicFFTPlan<T>::build_bluestein_(){
+    size_t M = 1;
+    while (M < 2*N_-1) M <<= 1;
+    conv_plan_ = BasicFFTPlan::get(M);
+
+    chirp_.resize(N_);
+    for (size_t n = 0; n<N_; n++){
+        size_t n2 = (n*n) % (2*N_); // keeping the argument small for the accuracy of the chirp
+        chirp_[n] = root_(static_cast<double>(n2), static_cast<double>(2*N_));
+    }
+
+    chirp_spectrum_.assign(M, complex_type(0));
+    chirp_spectrum_[0] = std::conj(chirp_[0]);
+    for (size_t n = 1; n<N_; n++){
+        chirp_spectrum_[n] = chirp_spectrum_[M-n] = std::conj(chirp_[n]);
     }
+    conv_plan_->forward(chirp_spectrum_.data());
+    for (auto& x : chirp_spectrum_) x /= static_cast<T>(M);
+}
 
-    cmplx_field result = FFT(x);
+template<typename T>
+typename BasicFFTPlan<T>::Cache& BasicFFTPlan<T>::cache_(){
+    static Cache cache;
+    return cache;
+}
 
-    for (auto& val : result) {
-        val = std::conj(val) / static_cast<double>(result.size());
+// dropping the least recently used plans (except keep) until the cache fits its limit
+// every file length of a batch can need its own plan, a cache that only grows would keep all of them
+template<typename T>
+void BasicFFTPlan<T>::Cache::evict_(size_t keep){
+    while (bytes > limit){
+        auto oldest = entries.end();
+        for (auto it = entries.begin(); it != entries.end(); ++it){
+            if (it->first != keep && (oldest == entries.end() || it->second.last_use < oldest->second.last_use)) oldest = it;
+        }
+        if (oldest == entries.end()) return;
+        bytes -= oldest->second.bytes;
+        entries.erase(oldest);
     }
+}
+
+template<typename T>
+std::shared_ptr<const BasicFFTPlan<T>> BasicFFTPlan<T>::get(size_t N){
+    Cache& cache = cache_();
+    {
+        std::lock_guard<std::mutex> lock(cache.mutex);
+        auto it = cache.entries.find(N);
+        if (it != cache.entries.end()){
+            it->second.last_use = ++cache.clock;
+            return it->second.plan;
+        }
+    }
+
+    // building outside of the lock, a bluestein plan requests its convolution plan while being built
+    auto plan = std::make_shared<const BasicFFTPlan>(N);
+    std::lock_guard<std::mutex> lock(cache.mutex);
+    auto [it, inserted] = cache.entries.try_emplace(N, CacheEntry{plan, plan->size_bytes(), 0});
+    it->second.last_use = ++cache.clock;
+    if (inserted){
+        cache.bytes += it->second.bytes;
+        cache.evict_(N);
+    }
+    return it->second.plan;
+}
+
+template<typename T>
+void BasicFFTPlan<T>::set_cache_limit(size_t bytes){
+    Cache& cache = cache_();
+    std::lock_guard<std::mutex> lock(cache.mutex);
+    cache.limit = bytes;
+    cache.evict_(SIZE_MAX);
+}
+
+template<typename T>
+size_t BasicFFTPlan<T>::cache_bytes(){
+    Cache& cache = cache_();
+    std::lock_guard<std::mutex> lock(cache.mutex);
+    return cache.bytes;
+}
+
+template<typename T>
+size_t BasicFFTPlan<T>::size_bytes() const{
+    // the window and the real-transform twiddles are counted up front, the cache accounts a plan once
+    size_t bytes = sizeof(BasicFFTPlan) + N_*sizeof(T) + N_/2*sizeof(complex_type);
+    bytes += bit_reversal_.capacity()*sizeof(uint32_t) + twiddles_.capacity()*sizeof(complex_type);
+    bytes += stages_.capacity()*sizeof(Stage) + stage_twiddles_.capacity()*sizeof(complex_type);
+    bytes += chirp_.capacity()*sizeof(complex_type) + chirp_spectrum_.capacity()*sizeof(complex_type);
+    return bytes;
+}
+
+template<typename T>
+void BasicFFTPlan<T>::forward(complex_type* data) const{
+    if (N_ <= 1) return;
+    ProfileTimer timer(ProfileStage::fft, N_*sizeof(complex_type));
+    timer.record_fft_size(N_);
+    switch (algorithm_){
+        case Algorithm::radix2: radix2_(data); break;
+        case Algorithm::mixed_radix: mixed_radix_(data); break;
+        case Algorithm::bluestein: bluestein_(data); break;
+    }
+}
 
+template<typename T>
+void BasicFFTPlan<T>::radix2_(complex_type* data) const{
+    for (size_t i = 0; i<N_; i++){
+        size_t j = bit_reversal_[i];
+        if (i < j) std::swap(data[i], data[j]);
+    }
+
+    // iterative butterflies, doubling the span of the sub-transforms in each stage
+    for (size_t len = 2; len<=N_; len<<=1){
+        size_t half = len/2;
+        const complex_type* w = &twiddles_[half-1];
+        for (size_t start = 0; start<N_; start+=len){
+            kernels_.butterflies(data + start, data + start + half, w, half);
+        }
+    }
+}
+
+template<typename T>
+void BasicFFTPlan<T>::mixed_radix_(complex_type* data) const{
+    // self-sorting (Stockham) decimation in frequency, ping-ponging between data and a scratch buffer
+    complex_type* x = data;
+    complex_type* y = fftScratch<T>(0, N_);
+
+    for (const Stage& stage : stages_){
+        const size_t p = stage.radix, m = stage.m, s = stage.stride;
+        const complex_type* tw = &stage_twiddles_[stage.twiddle_offset];
+
+        if (p == 4){
+            for (size_t q = 0; q<m; q++){
+                kernels_.radix4(x + s*q, s*m, y + s*p*q, s, tw + q*3, s);
+            }
+            std::swap(x, y);
+            continue;
+        }
+
+        // roots of unity for the generic radix-p butterfly
+        complex_type roots[7];
+        for (size_t k = 0; k<p; k++) roots[k] = root_(static_cast<double>(k), static_cast<double>(p));
+        const T sin60 = static_cast<T>(std::sqrt(3.0)/2);
+
+        for (size_t q = 0; q<m; q++){
+            const complex_type* w = tw + q*(p-1);
+            for (size_t r = 0; r<s; r++){
+                const complex_type* in = x + r + s*q;
+                complex_type* out = y + r + s*p*q;
+                const size_t in_step = s*m;
+
+                if (p == 2){
+                    complex_type a0 = in[0], a1 = in[in_step];
+                    out[0] = a0 + a1;
+                    out[s] = complexMultiply(a0 - a1, w[0]);
+                }else if (p == 3){
+                    complex_type a0 = in[0], a1 = in[in_step], a2 = in[2*in_step];
+                    complex_type t1 = a1 + a2;
+                    complex_type t2 = a0 - T(0.5)*t1;
+                    complex_type d = sin60*(a1 - a2);
+                    complex_type t3(d.imag(), -d.real()); // -i*sin(60)*(a1-a2)
+                    out[0] = a0 + t1;
+                    out[s] = complexMultiply(t2 + t3, w[0]);
+                    out[2*s] = complexMultiply(t2 - t3, w[1]);
+                }else{
+                    complex_type a[7];
+                    for (size_t j = 0; j<p; j++) a[j] = in[j*in_step];
+                    for (size_t k = 0; k<p; k++){
+                        complex_type sum = a[0];
+                        for (size_t j = 1; j<p; j++) sum += complexMultiply(a[j], roots[(j*k)%p]);
+                        out[k*s] = (k == 0 ? sum : complexMultiply(sum, w[k-1]));
+                    }
+                }
+            }
+        }
+        std::swap(x, y);
+    }
+
+    if (x != data) std::copy(x, x + N_, data);
+}
+
+template<typename T>
+void BasicFFTPlan<T>::bluestein_(complex_type* data) const{
+    // the transform is rewritten as a convolution with a chirp, which is evaluated by power of two sized ffts
+    const size_t M = conv_plan_->size();
+    complex_type* buffer = fftScratch<T>(1, M);
+    for (size_t n = 0; n<N_; n++) buffer[n] = complexMultiply(data[n], chirp_[n]);
+    std::fill(buffer + N_, buffer + M, complex_type(0));
+
+    conv_plan_->forward(buffer);
+    for (size_t k = 0; k<M; k++) buffer[k] = std::conj(complexMultiply(buffer[k], chirp_spectrum_[k]));
+    conv_plan_->forward(buffer); // inverse transform through the conjugate
+
+    for (size_t k = 0; k<N_; k++) data[k] = complexMultiply(chirp_[k], std::conj(buffer[k]));
+}
+
+template<typename T>
+void BasicFFTPlan<T>::inverse(complex_type* data) const{
+    ProfileTimer timer(ProfileStage::fft, N_*sizeof(complex_type));
+    timer.record_fft_size(N_);
+    for (size_t i = 0; i<N_; i++) data[i] = std::conj(data[i]);
+    forward(data);
+    T scale = T(1)/static_cast<T>(N_);
+    for (size_t i = 0; i<N_; i++) data[i] = std::conj(data[i]) * scale;
+}
+
+template<typename T>
+void BasicFFTPlan<T>::forwardReal(const T* in, complex_type* out) const{
+    ProfileTimer timer(ProfileStage::fft, N_*sizeof(T));
+    timer.record_fft_size(N_);
+    if (N_ <= 1){
+        if (N_ == 1) out[0] = in[0];
+        return;
+    }
+    if (N_%2 != 0){
+        // odd lengths cannot be packed into a half-length transform
+        complex_type* buffer = fftScratch<T>(2, N_);
+        for (size_t n = 0; n<N_; n++) buffer[n] = in[n];
+        forward(buffer);
+        std::copy(buffer, buffer + N_/2 + 1, out);
+        return;
+    }
+
+    std::call_once(real_once_, [this](){
+        half_plan_ = BasicFFTPlan::get(N_/2);
+        real_twiddles_.resize(N_/2);
+        for (size_t k = 0; k<N_/2; k++){
+            real_twiddles_[k] = root_(static_cast<double>(k), static_cast<double>(N_));
+        }
+    });
+
+    // packing even samples into the real and odd samples into the imaginary part
+    size_t M = N_/2;
+    for (size_t n = 0; n<M; n++){
+        out[n] = complex_type(in[2*n], in[2*n+1]);
+    }
+    half_plan_->forward(out);
+
+    // splitting the packed spectrum into the spectra of the even and odd samples and recombining them
+    complex_type z0 = out[0];
+    out[0] = z0.real() + z0.imag();
+    out[M] = z0.real() - z0.imag();
+    for (size_t k = 1; k<=M/2; k++){
+        complex_type a = out[k];
+        complex_type b = std::conj(out[M-k]);
+        complex_type even = T(0.5)*(a + b);
+        complex_type diff = a - b;
+        complex_type odd(T(0.5)*diff.imag(), T(-0.5)*diff.real()); // -i/2*(a-b)
+        complex_type t = complexMultiply(real_twiddles_[k], odd);
+        out[k] = even + t;
+        out[M-k] = std::conj(even - t);
+    }
+}
+
+// Hann window of length n written into window (no allocation once its capacity suffices)
+template<typename T>
+void hannWindow(size_t n, std::vector<T>& window){
+    window.resize(n);
+    if (n == 1) window[0] = 1;
+    for (size_t i = 0; i<n && n>1; ++i){
+        window[i] = static_cast<T>(0.5 * (1 - std::cos(2 * M_PI * static_cast<double>(i) / static_cast<double>(n - 1)))); // Hann window formula
+    }
+}
+
+template<typename T>
+const std::vector<T>& BasicFFTPlan<T>::hannWindow() const{
+    std::call_once(window_once_, [this](){::hannWindow(N_, window_);});
+    return window_;
+}
+
+cmplx_field FFT(cmplx_field & x) {
+    cmplx_field result(x);
+    FFTPlan::get(result.size())->forward(result.data());
+    return result;
+}
+
+// real-to-half-complex transform, returns only the bins 0..N/2 of the N-point spectrum
+cmplx_field RFFT(const std::vector<double>& x) {
+    cmplx_field result(x.size()/2 + 1);
+    FFTPlan::get(x.size())->forwardReal(x.data(), result.data());
+    return result;
+}
+
+cmplx_field IFFT(cmplx_field & x) {
+    cmplx_field result(x);
+    FFTPlan::get(result.size())->inverse(result.data());
     return result;
 }
 
@@ -70,14 +505,10 @@ cmplx_field DFT(cmplx_field & signal){
     return output;
 }
 
-std::vector<double> computeMagnitudes(cmplx_field& cmplx){
-    size_t N = cmplx.size();
-    std::vector<double> magnitudes(N);
-    for (size_t i=0; i<N; ++i){
-        double real = cmplx[i].real();
-        double imag = cmplx[i].imag();
-        magnitudes[i] = sqrt(real*real + imag*imag);
-    }
+template<typename T>
+std::vector<T> computeMagnitudes(std::vector<std::complex<T>>& cmplx){
+    std::vector<T> magnitudes(cmplx.size());
+    SpectralKernels<T>::get().magnitudes(cmplx.data(), magnitudes.data(), cmplx.size());
     return magnitudes;
 }
 
@@ -87,30 +518,42 @@ std::vector<double> amplitudeSpectrum(cmplx_field& cmplx);
 
 std::vector<double> powerSpectrum(cmplx_field& cmplx);
 
-std::vector<double> powerSpectralDensity(cmplx_field& cmplx, int num_samples, int sample_rate){
-    std::vector<double> magnitudes = computeMagnitudes(cmplx);
-    std::vector<double> spectrum;
-    int upper_bound = ceil((num_samples+1)/2.0);
+// cmplx may hold either the full spectrum or only the bins 0..num_samples/2 as returned by RFFT
+// spectrum receives the values of the one-sided density at the bins first_bin..end_bin-1 (at most num_samples/2+1 bins),
+// its other values are left untouched
+template<typename T>
+void powerSpectralDensity(const std::complex<T>* cmplx, int num_samples, int sample_rate, T* spectrum, size_t first_bin, size_t end_bin){
+    const size_t upper_bound = num_samples/2 + 1;
+    end_bin = std::min(end_bin, upper_bound);
+    if (first_bin >= end_bin) return;
 
-    spectrum.reserve(upper_bound);
-for (int i = 0; i<upper_bound; i++){
-        spectrum.push_back(2*magnitudes[i]*magnitudes[i]/num_samples/sample_rate);
-    }
+    T scale = static_cast<T>(2.0/num_samples/sample_rate);
+    SpectralKernels<T>::get().scaledNorms(cmplx + first_bin, spectrum + first_bin, end_bin - first_bin, scale);
 
-    spectrum[0]/=2; // the zero frequency is unique
-    if (num_samples%2 == 0) spectrum[upper_bound-1]/=2; // the Nyquist frequency is unique
+    if (first_bin == 0) spectrum[0]/=2; // the zero frequency is unique
+    if (num_samples%2 == 0 && end_bin == upper_bound) spectrum[upper_bound-1]/=2; // the Nyquist frequency is unique
+}
 
-    return spectrum;
+// all num_samples/2+1 bins
+template<typename T>
+void powerSpectralDensity(const std::complex<T>* cmplx, int num_samples, int sample_rate, T* spectrum){
+    powerSpectralDensity(cmplx, num_samples, sample_rate, spectrum, 0, num_samples/2 + 1);
+}
 
+template<typename T>
+std::vector<T> powerSpectralDensity(std::vector<std::complex<T>>& cmplx, int num_samples, int sample_rate){
+    std::vector<T> spectrum(num_samples/2 + 1);
+    powerSpectralDensity(cmplx.data(), num_samples, sample_rate, spectrum.data());
+    return spectrum;
 }
 
 // windowing function - for minimizing spectral leakage
-void applyHannWindow(std::vector<double>& data) {
-    int N = (int)data.size();
-    for (int n = 0; n < N; ++n) {
-        double windowValue = 0.5 * (1 - std::cos(2 * M_PI * n / (N - 1))); // Hann window formula
-        data[n] *= windowValue; // Apply the window
-    }
+// the window is kept per thread and recomputed when the length changes, no fft plan is built for it
+template<typename T>
+void applyHannWindow(std::vector<T>& data) {
+    thread_local std::vector<T> window;
+    if (window.size() != data.size()) hannWindow(data.size(), window);
+    SpectralKernels<T>::get().multiply(data.data(), window.data(), data.size());
 }
 
 #endif //FOURIER_TRANSFORM_DFT_H
@@ -0,0 +1,214 @@
+//
+// Created by Samuel Longauer on 17/10/2026.
+//
+
+#ifndef PROJECT_MAPPED_FILE_H
+#define PROJECT_MAPPED_FILE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <span>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define AUDIO_TRANSCRIBER_HAS_MMAP 1
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// read-only view of a whole file, memory-mapped where the platform supports it (otherwise read into memory)
+class MappedFile {
+public:
+    MappedFile() = default;
+    explicit MappedFile(const std::string& filename);
+    ~MappedFile();
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+    MappedFile(MappedFile&& other) noexcept;
+    MappedFile& operator=(MappedFile&& other) noexcept;
+
+    bool is_open() const {return is_open_;}
+    const uint8_t* data() const {return data_;}
+    size_t size() const {return size_;}
+    std::span<const uint8_t> bytes() const {return {data_, size_};}
+    // hint that the bytes offset..offset+length are not read again, their pages stop counting to the resident memory
+    // (a mapped page that is touched later is simply read from the file again)
+    void discard(size_t offset, size_t length) const;
+
+private:
+    bool is_open_ = false;
+    const uint8_t* data_ = nullptr;
+    size_t size_ = 0;
+    bool mapped_ = false;
+    std::vector<uint8_t> buffer_; // fallback storage when the file is not mapped
+
+    void release_();
+};
+
+MappedFile::MappedFile(const std::string& filename){
+#ifdef AUDIO_TRANSCRIBER_HAS_MMAP
+    int fd = ::open(filename.c_str(), O_RDONLY);
+    if (fd < 0) return;
+    struct stat info{};
+    if (::fstat(fd, &info) == 0){
+        size_ = static_cast<size_t>(info.st_size);
+        if (size_ == 0){
+            is_open_ = true;
+        }else{
+            void* address = ::mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (address != MAP_FAILED){
+                ::madvise(address, size_, MADV_SEQUENTIAL); // the decoders walk the file front to back
+                data_ = static_cast<const uint8_t*>(address);
+                mapped_ = true;
+                is_open_ = true;
+            }
+        }
+    }
+    ::close(fd);
+    if (is_open_) return;
+#endif
+    std::ifstream file(filename, std::ios::in | std::ios::binary | std::ios::ate);
+    if (!file.is_open()) return;
+    buffer_.resize(static_cast<size_t>(file.tellg()));
+    file.seekg(0);
+    file.read(reinterpret_cast<char*>(buffer_.data()), static_cast<std::streamsize>(buffer_.size()));
+    data_ = buffer_.data();
+    size_ = buffer_.size();
+    is_open_ = true;
+}
+
+MappedFile::~MappedFile(){
+    release_();
+}
+
+MappedFile::MappedFile(MappedFile&& other) noexcept{
+    *this = std::move(other);
+}
+
+MappedFile& MappedFile::operator=(MappedFile&& other) noexcept{
+    if (this != &other){
+        release_();
+        is_open_ = other.is_open_;
+        size_ = other.size_;
+        mapped_ = other.mapped_;
+        buffer_ = std::move(other.buffer_);
+        data_ = mapped_ ? other.data_ : buffer_.data();
+        other.is_open_ = false;
+        other.data_ = nullptr;
+        other.size_ = 0;
+        other.mapped_ = false;
+    }
+    return *this;
+}
+
+void MappedFile::discard(size_t offset, size_t length) const{
+#ifdef AUDIO_TRANSCRIBER_HAS_MMAP
+    if (!mapped_) return;
+    const auto page = static_cast<uintptr_t>(::sysconf(_SC_PAGESIZE));
+    const auto begin = reinterpret_cast<uintptr_t>(data_) + offset;
+    const uintptr_t first = (begin + page - 1)/page*page; // only the pages lying wholly inside the range
+    const uintptr_t last = (begin + length)/page*page;
+    if (last > first) ::madvise(reinterpret_cast<void*>(first), last - first, MADV_DONTNEED);
+#else
+    (void)offset;
+    (void)length;
+#endif
+}
+
+void MappedFile::release_(){
+#ifdef AUDIO_TRANSCRIBER_HAS_MMAP
+    if (mapped_) ::munmap(const_cast<uint8_t*>(data_), size_);
+#endif
+    mapped_ = false;
+    data_ = nullptr;
+    size_ = 0;
+    is_open_ = false;
+    buffer_.clear();
+}
+
+// writable file of a size known up front, memory-mapped where the platform supports it (otherwise filled in memory
+// and written out in one piece by close)
+class MappedOutputFile {
+public:
+    MappedOutputFile(const std::string& filename, size_t size);
+    ~MappedOutputFile();
+    MappedOutputFile(const MappedOutputFile&) = delete;
+    MappedOutputFile& operator=(const MappedOutputFile&) = delete;
+
+    bool is_open() const {return is_open_;}
+    uint8_t* data() {return data_;}
+    size_t size() const {return size_;}
+    // returns false when the contents could not be stored
+    bool close();
+
+private:
+    std::string filename_;
+    bool is_open_ = false;
+    uint8_t* data_ = nullptr;
+    size_t size_ = 0;
+    bool mapped_ = false;
+    std::vector<uint8_t> buffer_;
+};
+
+MappedOutputFile::MappedOutputFile(const std::string& filename, size_t size) : filename_(filename), size_(size){
+#ifdef AUDIO_TRANSCRIBER_HAS_MMAP
+    int fd = ::open(filename.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) return;
+    if (size_ == 0){
+        is_open_ = true;
+        ::close(fd);
+        return;
+    }
+    // reserving the blocks up front, so that running out of space shows up here instead of as a fault while writing
+    bool sized = false;
+#if defined(__linux__)
+    sized = ::posix_fallocate(fd, 0, static_cast<off_t>(size_)) == 0;
+#endif
+    if (!sized) sized = ::ftruncate(fd, static_cast<off_t>(size_)) == 0;
+    if (sized){
+        void* address = ::mmap(nullptr, size_, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (address != MAP_FAILED){
+            data_ = static_cast<uint8_t*>(address);
+            mapped_ = true;
+            is_open_ = true;
+        }
+    }
+    ::close(fd);
+    if (is_open_) return;
+#endif
+    std::ofstream file(filename, std::ios::out | std::ios::binary | std::ios::trunc);
+    if (!file.is_open()) return;
+    buffer_.resize(size_);
+    data_ = buffer_.data();
+    is_open_ = true;
+}
+
+MappedOutputFile::~MappedOutputFile(){
+    close();
+}
+
+bool MappedOutputFile::close(){
+    if (!is_open_) return false;
+    bool stored = true;
+#ifdef AUDIO_TRANSCRIBER_HAS_MMAP
+    if (mapped_){
+        stored = ::munmap(data_, size_) == 0;
+    }
+#endif
+    if (!mapped_ && size_ > 0){
+        std::ofstream file(filename_, std::ios::out | std::ios::binary | std::ios::trunc);
+        file.write(reinterpret_cast<const char*>(buffer_.data()), static_cast<std::streamsize>(buffer_.size()));
+        stored = static_cast<bool>(file);
+    }
+    is_open_ = false;
+    mapped_ = false;
+    data_ = nullptr;
+    buffer_.clear();
+    return stored;
+}
+
+#endif //PROJECT_MAPPED_FILE_H
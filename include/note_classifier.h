@@ -6,45 +6,64 @@
 #define PROJECT_NOTE_CLASSIFIER_H
 
 #include <cmath>
+#include <cstdint>
 #include <string>
-#include <vector>
+#include <array>
 
-double HALF_STEP = std::pow(2, 1.0/12);
-double QUARTER_STEP = std::pow(2, 1.0/24);
+constexpr double HALF_STEP = 1.0594630943592953; // 2^(1/12)
+constexpr double QUARTER_STEP = 1.0293022366434921; // 2^(1/24)
 
+constexpr int NOTE_OCTAVES = 9;
+constexpr int NUM_NOTES = NOTE_OCTAVES*12; // C0..B8
+constexpr int MIDI_C0 = 12;
+
+// frequencies of the 108 recognized pitches, every octave starts from its tabulated C and climbs by half steps
+constexpr std::array<double, NUM_NOTES> note_frequencies(){
+    constexpr double C_Hz[NOTE_OCTAVES] = {16.352, 32.703, 65.406, 130.813, 261.626, 523.251, 1046.502, 2093.005, 4186.009};
+    std::array<double, NUM_NOTES> frequencies{};
+    for (int i = 0; i<NOTE_OCTAVES; i++){
+        double base_note = C_Hz[i];
+        for (int j = 0; j<12; j++){
+            frequencies[i*12 + j] = base_note;
+            base_note*=HALF_STEP;
+        }
+    }
+    return frequencies;
+}
+
+// compact description of the pitch closest to a frequency - the label is only rendered on demand (repr)
 class NoteClassifier{
 public:
     explicit NoteClassifier(double);
     double freq;
-    std::string repr;
+    float cents = 0; // deviation of freq from the closest pitch
+    int16_t midi = -1; // MIDI number of the closest pitch (C0 is 12), -1 when out of range
     bool out_of_range = true;
     bool operator<(const NoteClassifier& other) const {
         return this->freq < other.freq;
     }
+
+    int index() const {return midi - MIDI_C0;} // position within C0..B8
+    int octave() const {return index()/12;}
+    const char* name() const {return notation_[index()%12];}
+    std::string repr() const; // label describing the closest note and octave, e.g. "C#/Db(4)", empty when out of range
+
+    static constexpr std::array<double, NUM_NOTES> table = note_frequencies();
+
 private:
-    static const int octaves_ = 9;
-    double C_Hz[octaves_] = {16.352, 32.703, 65.406, 130.813, 261.626, 523.251, 1046.502, 2093.005, 4186.009};
-    std::vector<std::string> notation_ = {"C", "C#/Db", "D", "D#/Eb", "E", "F", "F#/Gb", "G", "G#/Ab", "A", "A#/Bb", "B"};
-    std::vector<double> noteFrequencies_;
-    void calculate_frequencies_();
-    void classify_freq_(); // assigning a label describing the closest note and octave
+    static constexpr const char* notation_[12] = {"C", "C#/Db", "D", "D#/Eb", "E", "F", "F#/Gb", "G", "G#/Ab", "A", "A#/Bb", "B"};
+    void classify_freq_(); // assigning the closest note and its deviation
 };
 
 
 NoteClassifier::NoteClassifier(double freq){
     this->freq = freq;
-    calculate_frequencies_();
     classify_freq_();
 }
 
-void NoteClassifier::calculate_frequencies_(){
-    for (int i = 0; i<octaves_; i++){
-        double base_note = C_Hz[i];
-        for (int j = 0; j<12; j++){
-            this->noteFrequencies_.push_back(base_note);
-            base_note*=HALF_STEP;
-        }
-    }
+std::string NoteClassifier::repr() const{
+    if (out_of_range) return {};
+    return std::string(name()) + "(" + std::to_string(octave()) + ")";
 }
 
 void NoteClassifier::classify_freq_(){
@@ -53,34 +72,34 @@ void NoteClassifier::classify_freq_(){
 
     // testing bounds
     int lower_bound = 0;
-    int upper_bound = octaves_*12 - 1;
+    int upper_bound = NUM_NOTES - 1;
 
-    if (freq <=noteFrequencies_[lower_bound]){
-        double tolerance = noteFrequencies_[lower_bound]/QUARTER_STEP;
+    if (freq <=table[lower_bound]){
+        double tolerance = table[lower_bound]/QUARTER_STEP;
         if (freq > tolerance){
             note_index = lower_bound;
         }
-    }else if (freq >= noteFrequencies_[upper_bound]){
-        double tolerance = noteFrequencies_[upper_bound]*QUARTER_STEP;
+    }else if (freq >= table[upper_bound]){
+        double tolerance = table[upper_bound]*QUARTER_STEP;
         if (freq < tolerance){
             note_index = upper_bound;
         }
-    }else{
-        for (int note = 0; note<noteFrequencies_.size(); note++){
-            if (freq >= noteFrequencies_[note] && freq <=noteFrequencies_[note+1]){
-                double midway = noteFrequencies_[note]*QUARTER_STEP;
-                note_index = (freq<midway ? note : note+1);
-                break;
-            }
-        }
+    }else if (freq == freq){
+        // the estimate from log2 lands on the right interval up to the rounding of the tabulated octaves,
+        // the table comparisons settle the rest so that the boundaries are exactly those of the table
+        int note = static_cast<int>(std::log2(freq/table[0])*12);
+        note = note < 0 ? 0 : (note > upper_bound-1 ? upper_bound-1 : note);
+        while (note > 0 && freq < table[note]) note--;
+        while (note < upper_bound-1 && freq > table[note+1]) note++;
+
+        double midway = table[note]*QUARTER_STEP;
+        note_index = (freq<midway ? note : note+1);
     }
 
     if (note_index >=0){
-        int octave_ord = note_index/12;
-        int note = note_index%12;
         this->out_of_range = false;
-        this->repr = notation_[note] + "(" + std::to_string(octave_ord) + ")";
-
+        this->midi = static_cast<int16_t>(note_index + MIDI_C0);
+        this->cents = static_cast<float>(1200*std::log2(freq/table[note_index]));
     }
 }
 
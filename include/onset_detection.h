@@ -0,0 +1,102 @@
+//
+// Created by Samuel Longauer on 17/10/2026.
+//
+
+#ifndef PROJECT_ONSET_DETECTION_H
+#define PROJECT_ONSET_DETECTION_H
+
+#include <algorithm>
+#include <cmath>
+#include <complex>
+#include <span>
+#include <utility>
+#include <vector>
+#include "dft.h"
+
+// tuning of the onset detection pass
+struct OnsetOptions {
+    double frame_duration = 0.023; // seconds, rounded up to a power of two number of samples
+    double threshold = 0.05; // fraction of the strongest flux an onset has to exceed the local median by
+    double min_interval = 0.05; // seconds between two onsets, closer ones are merged
+    int peak_radius = 3; // frames an onset has to dominate on both sides
+    int median_radius = 10; // frames of the moving median on both sides
+};
+
+// spectral flux of the summed channels: the rectified increase of the log-compressed magnitude spectrum between
+// consecutive short frames, one value per hop (half of a frame)
+template<typename S>
+std::vector<float> spectralFlux(const std::vector<std::span<const S>>& channels, size_t frame_length){
+    const size_t hop = frame_length/2;
+    size_t num_samples = 0;
+    for (auto&& channel : channels) num_samples = std::max(num_samples, channel.size());
+    const size_t num_frames = num_samples > frame_length ? (num_samples - frame_length)/hop + 1 : 1;
+
+    const std::shared_ptr<const BasicFFTPlan<float>> plan = BasicFFTPlan<float>::get(frame_length);
+    const std::vector<float>& window = plan->hannWindow();
+    const SpectralKernels<float>& kernels = SpectralKernels<float>::get();
+    const size_t num_bins = frame_length/2 + 1;
+
+    std::vector<float> frame(frame_length);
+    std::vector<std::complex<float>> spectrum(num_bins);
+    std::vector<float> magnitudes(num_bins);
+    std::vector<std::vector<float>> previous(channels.size(), std::vector<float>(num_bins, 0));
+
+    std::vector<float> flux(num_frames, 0);
+    for (size_t c = 0; c<channels.size(); c++){
+        std::span<const S> channel = channels[c];
+        for (size_t n = 0; n<num_frames; n++){
+            size_t start = n*hop;
+            for (size_t i = 0; i<frame_length; i++){
+                frame[i] = start + i < channel.size() ? static_cast<float>(channel[start + i])*window[i] : 0.0f;
+            }
+            plan->forwardReal(frame.data(), spectrum.data());
+            kernels.magnitudes(spectrum.data(), magnitudes.data(), num_bins);
+
+            float sum = 0;
+            for (size_t k = 0; k<num_bins; k++){
+                float compressed = std::log1p(magnitudes[k]);
+                if (n > 0) sum += std::max(0.0f, compressed - previous[c][k]);
+                previous[c][k] = compressed;
+            }
+            flux[n] += sum;
+        }
+    }
+    return flux;
+}
+
+// sample positions where new note events start, the first boundary is always 0
+// an onset is a local maximum of the spectral flux that rises above the moving median by a share of the strongest flux
+template<typename S>
+std::vector<size_t> detectOnsets(const std::vector<std::span<const S>>& channels, int sample_rate, const OnsetOptions& options = OnsetOptions()){
+    size_t frame_length = 1;
+    while (frame_length < static_cast<size_t>(options.frame_duration*sample_rate)) frame_length *= 2;
+    frame_length = std::max<size_t>(frame_length, 4);
+    const size_t hop = frame_length/2;
+
+    std::vector<float> flux = spectralFlux(channels, frame_length);
+    std::vector<size_t> boundaries = {0};
+    float max_flux = flux.empty() ? 0 : *std::max_element(flux.begin(), flux.end());
+    if (max_flux <= 0) return boundaries;
+
+    const long num_frames = static_cast<long>(flux.size());
+    const size_t min_interval = static_cast<size_t>(options.min_interval*sample_rate);
+    std::vector<float> neighbourhood;
+    for (long n = 1; n<num_frames; n++){
+        long first = std::max(0L, n - options.peak_radius), last = std::min(num_frames - 1, n + options.peak_radius);
+        if (*std::max_element(flux.begin() + first, flux.begin() + last + 1) != flux[n]) continue;
+
+        first = std::max(0L, n - options.median_radius);
+        last = std::min(num_frames - 1, n + options.median_radius);
+        neighbourhood.assign(flux.begin() + first, flux.begin() + last + 1);
+        std::nth_element(neighbourhood.begin(), neighbourhood.begin() + neighbourhood.size()/2, neighbourhood.end());
+        if (flux[n] < neighbourhood[neighbourhood.size()/2] + options.threshold*max_flux) continue;
+
+        // the attack enters the frame with its newest hop
+        size_t position = n*hop + frame_length - hop;
+        if (position - boundaries.back() < min_interval) continue;
+        boundaries.push_back(position);
+    }
+    return boundaries;
+}
+
+#endif //PROJECT_ONSET_DETECTION_H
@@ -0,0 +1,186 @@
+//
+// Created by Samuel Longauer on 17/10/2026.
+//
+
+#ifndef PROJECT_PROFILER_H
+#define PROJECT_PROFILER_H
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+// the stages of the pipeline the profile is broken down into
+enum class ProfileStage {decode, decimation, analysis, onsets, segment, windowing, fft, psd, peaks, classification, cqt, synthesis, audio_output, transcript, count};
+
+// per-thread wall time, call counts, bytes and heap allocations of the pipeline stages
+// the timers of a stage do not nest - a stage entered again on the same thread (an fft calling a smaller fft, a segment
+// of a channel) is accounted to the outermost call only, different stages do nest (the fft time is part of the segment time)
+// while the profiler is disabled a timer costs one relaxed atomic load
+class Profiler {
+public:
+    static bool enabled(){return enabled_.load(std::memory_order_relaxed);}
+    static void enable(){enabled_.store(true, std::memory_order_relaxed);}
+    // counter of the heap allocations made by the calling thread, without it the allocations are not reported
+    static void set_allocation_counter(size_t (*counter)()){allocation_counter_ = counter;}
+
+    // writes the statistics of every thread and their total as JSON, throws std::runtime_error when the file cannot be opened
+    static void write_json(const std::string& filePath);
+
+private:
+    friend class ProfileTimer;
+    static constexpr size_t num_stages = static_cast<size_t>(ProfileStage::count);
+
+    struct StageStats {
+        uint64_t calls = 0;
+        uint64_t nanoseconds = 0;
+        uint64_t bytes = 0;
+        uint64_t allocations = 0;
+    };
+
+    struct ThreadProfile {
+        size_t id = 0;
+        uint32_t active = 0; // stages with a running timer on this thread
+        std::mutex mutex; // taken by the owner while it records, and by write_json
+        std::array<StageStats, num_stages> stages;
+        std::map<size_t, uint64_t> fft_sizes; // transforms per length
+    };
+
+    static inline std::atomic<bool> enabled_{false};
+    static inline size_t (*allocation_counter_)() = nullptr;
+    static inline std::mutex registry_mutex_;
+    static inline std::vector<std::shared_ptr<ThreadProfile>> registry_; // kept after their threads exit
+
+    static ThreadProfile& local();
+    static size_t allocations(){return allocation_counter_ ? allocation_counter_() : 0;}
+    static const char* stage_name(size_t stage);
+    static void write_stats(std::ofstream& out, const std::array<StageStats, num_stages>& stages, const std::map<size_t, uint64_t>& fft_sizes);
+};
+
+// accounts the time from its construction to its destruction to a stage
+class ProfileTimer {
+public:
+    explicit ProfileTimer(ProfileStage stage, uint64_t bytes = 0){
+        if (Profiler::enabled()) start_(stage, bytes);
+    }
+    ~ProfileTimer(){
+        if (profile_) stop_();
+    }
+    ProfileTimer(const ProfileTimer&) = delete;
+    ProfileTimer& operator=(const ProfileTimer&) = delete;
+
+    // false when the profiler is disabled or an outer timer of the same stage is running
+    bool active() const {return profile_ != nullptr;}
+    void add_bytes(uint64_t bytes){bytes_ += bytes;}
+    void record_fft_size(size_t size){fft_size_ = size;}
+
+private:
+    Profiler::ThreadProfile* profile_ = nullptr;
+    size_t stage_ = 0;
+    uint64_t bytes_ = 0;
+    size_t fft_size_ = 0;
+    size_t allocations_ = 0;
+    std::chrono::steady_clock::time_point start_time_;
+
+    void start_(ProfileStage stage, uint64_t bytes);
+    void stop_();
+};
+
+Profiler::ThreadProfile& Profiler::local(){
+    thread_local std::shared_ptr<ThreadProfile> profile;
+    if (!profile){
+        profile = std::make_shared<ThreadProfile>();
+        std::lock_guard<std::mutex> lock(registry_mutex_);
+        profile->id = registry_.size();
+        registry_.push_back(profile);
+    }
+    return *profile;
+}
+
+const char* Profiler::stage_name(size_t stage){
+    static constexpr const char* names[num_stages] = {"decode", "decimation", "analysis", "onsets", "segment", "windowing", "fft", "psd", "peaks",
+                                                      "classification", "cqt", "synthesis", "audio_output", "transcript"};
+    return names[stage];
+}
+
+void Profiler::write_stats(std::ofstream& out, const std::array<StageStats, num_stages>& stages, const std::map<size_t, uint64_t>& fft_sizes){
+    out << "\"stages\": {";
+    bool first = true;
+    for (size_t s = 0; s<num_stages; s++){
+        const StageStats& stats = stages[s];
+        if (stats.calls == 0) continue;
+        out << (first ? "" : ", ") << "\"" << stage_name(s) << "\": {\"calls\": " << stats.calls
+            << ", \"seconds\": " << static_cast<double>(stats.nanoseconds)/1e9 << ", \"bytes\": " << stats.bytes;
+        if (allocation_counter_) out << ", \"allocations\": " << stats.allocations;
+        out << "}";
+        first = false;
+    }
+    out << "}, \"fft_sizes\": {";
+    first = true;
+    for (auto [size, count] : fft_sizes){
+        out << (first ? "" : ", ") << "\"" << size << "\": " << count;
+        first = false;
+    }
+    out << "}";
+}
+
+void Profiler::write_json(const std::string& filePath){
+    std::ofstream out(filePath);
+    if (!out.is_open()) throw std::runtime_error("The profile file cannot be opened");
+
+    std::lock_guard<std::mutex> registry_lock(registry_mutex_);
+    std::array<StageStats, num_stages> total;
+    std::map<size_t, uint64_t> total_fft_sizes;
+    out << "{\n  \"threads\": [";
+    for (size_t t = 0; t<registry_.size(); t++){
+        ThreadProfile& profile = *registry_[t];
+        std::lock_guard<std::mutex> lock(profile.mutex);
+        for (size_t s = 0; s<num_stages; s++){
+            total[s].calls += profile.stages[s].calls;
+            total[s].nanoseconds += profile.stages[s].nanoseconds;
+            total[s].bytes += profile.stages[s].bytes;
+            total[s].allocations += profile.stages[s].allocations;
+        }
+        for (auto [size, count] : profile.fft_sizes) total_fft_sizes[size] += count;
+
+        out << (t ? ",\n" : "\n") << "    {\"thread\": " << profile.id << ", ";
+        write_stats(out, profile.stages, profile.fft_sizes);
+        out << "}";
+    }
+    out << "\n  ],\n  \"total\": {";
+    write_stats(out, total, total_fft_sizes);
+    out << "}\n}\n";
+}
+
+void ProfileTimer::start_(ProfileStage stage, uint64_t bytes){
+    Profiler::ThreadProfile& profile = Profiler::local();
+    stage_ = static_cast<size_t>(stage);
+    if (profile.active & (1u << stage_)) return;
+    profile.active |= 1u << stage_;
+    profile_ = &profile;
+    bytes_ = bytes;
+    allocations_ = Profiler::allocations();
+    start_time_ = std::chrono::steady_clock::now();
+}
+
+void ProfileTimer::stop_(){
+    auto elapsed = std::chrono::steady_clock::now() - start_time_;
+    size_t allocations = Profiler::allocations() - allocations_;
+    std::lock_guard<std::mutex> lock(profile_->mutex);
+    Profiler::StageStats& stats = profile_->stages[stage_];
+    stats.calls++;
+    stats.nanoseconds += static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count());
+    stats.bytes += bytes_;
+    stats.allocations += allocations;
+    if (fft_size_ > 0) profile_->fft_sizes[fft_size_]++; // after reading the allocation counter, a new size allocates a node
+    profile_->active &= ~(1u << stage_);
+}
+
+#endif //PROJECT_PROFILER_H
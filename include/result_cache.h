@@ -0,0 +1,244 @@
+//
+// Created by Samuel Longauer on 17/10/2026.
+//
+
+#ifndef PROJECT_RESULT_CACHE_H
+#define PROJECT_RESULT_CACHE_H
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <random>
+#include <string>
+#include <vector>
+#include <stdexcept>
+#include "audio_analysis.h"
+#include "mapped_file.h"
+
+// 64-bit hash of a byte range, four independent multiply-xor lanes over 8-byte words (not cryptographic -
+// the cache entries also record the size of the input)
+uint64_t contentHash(const uint8_t* data, size_t size){
+    constexpr uint64_t prime = 0x9E3779B97F4A7C15ull;
+    auto mix = [](uint64_t h){
+        h ^= h >> 33;
+        h *= 0xFF51AFD7ED558CCDull;
+        h ^= h >> 33;
+        h *= 0xC4CEB9FE1A85EC53ull;
+        h ^= h >> 33;
+        return h;
+    };
+    uint64_t lanes[4] = {prime, prime ^ 1, prime ^ 2, prime ^ 3};
+    size_t i = 0;
+    for (; i + 32<=size; i += 32){
+        for (int k = 0; k<4; k++){
+            uint64_t word;
+            std::memcpy(&word, data + i + 8*k, 8);
+            lanes[k] = (lanes[k] ^ word)*prime;
+            lanes[k] ^= lanes[k] >> 29;
+        }
+    }
+    uint64_t h = size;
+    for (int k = 0; k<4; k++) h = mix(h ^ mix(lanes[k]));
+    for (; i<size; i++) h = (h ^ data[i])*prime;
+    return mix(h);
+}
+
+uint64_t contentHash(const std::string& text){
+    return contentHash(reinterpret_cast<const uint8_t*>(text.data()), text.size());
+}
+
+// on-disk cache of analysis results, keyed by the contents of the input file and the analysis settings
+// every segment keeps the peaks of depth notes ranked from the strongest, so any later run asking for at most depth notes
+// per segment is served without decoding or transforming the recording
+// once the entries outgrow max_bytes, the least recently used ones are removed
+class ResultCache {
+public:
+    static constexpr int default_depth = 16;
+
+    ResultCache(std::string directory, uint64_t max_bytes, int depth = default_depth);
+
+    // the result of analyzer.analyzeAudio(filePath), taken from the cache when possible (the analysis result is stored otherwise)
+    channel_field analyze(const AudioAnalyzer& analyzer, const std::string& filePath) const;
+
+private:
+    static constexpr char magic[4] = {'A', 'T', 'R', 'C'};
+    static constexpr uint32_t version = 1;
+    static constexpr const char* extension = ".atrc";
+
+    std::filesystem::path directory;
+    uint64_t max_bytes;
+    int depth;
+
+    // the first num_notes notes of every ranked chord, ordered by frequency as analyzeAudio returns them
+    static channel_field truncate(const channel_field& ranked, int num_notes);
+    bool load(const std::filesystem::path& path, const std::string& parameters, uint64_t input_size, int num_notes, channel_field& ranked) const;
+    void store(const std::filesystem::path& path, const std::string& parameters, uint64_t input_size, int stored_depth, const channel_field& ranked) const;
+    void evict() const;
+};
+
+ResultCache::ResultCache(std::string directory, uint64_t max_bytes, int depth) : directory(std::move(directory)), max_bytes(max_bytes), depth(depth){
+    std::error_code error;
+    std::filesystem::create_directories(this->directory, error);
+    if (!std::filesystem::is_directory(this->directory)) throw std::runtime_error("The cache directory cannot be created");
+}
+
+channel_field ResultCache::analyze(const AudioAnalyzer& analyzer, const std::string& filePath) const{
+    const int num_notes = analyzer.notes_per_segment();
+    const int stored_depth = std::max(depth, num_notes);
+    const AudioAnalyzer ranked_analyzer = analyzer.ranked(stored_depth);
+    const std::string parameters = ranked_analyzer.parameters();
+
+    uint64_t input_hash, input_size;
+    {
+        MappedFile file(filePath);
+        if (!file.is_open()) throw std::runtime_error("The file cannot be opened");
+        input_hash = contentHash(file.data(), file.size());
+        input_size = file.size();
+    }
+    char name[64];
+    std::snprintf(name, sizeof(name), "%016llx-%016llx", (unsigned long long)input_hash, (unsigned long long)contentHash(parameters));
+    std::filesystem::path path = directory / (std::string(name) + extension);
+
+    channel_field ranked;
+    if (load(path, parameters, input_size, num_notes, ranked)){
+        std::error_code error;
+        std::filesystem::last_write_time(path, std::filesystem::file_time_type::clock::now(), error); // most recently used
+        return truncate(ranked, num_notes);
+    }
+
+    ranked = ranked_analyzer.analyzeAudio(filePath);
+    store(path, parameters, input_size, stored_depth, ranked);
+    evict();
+    return truncate(ranked, num_notes);
+}
+
+channel_field ResultCache::truncate(const channel_field& ranked, int num_notes){
+    channel_field result(ranked.size());
+    for (size_t c = 0; c<ranked.size(); c++){
+        result[c].resize(ranked[c].size());
+        for (size_t i = 0; i<ranked[c].size(); i++){
+            const segment_chord& source = ranked[c][i];
+            segment_chord& chord = result[c][i];
+            chord.start = source.start;
+            chord.duration = source.duration;
+            size_t count = std::min(source.notes.size(), static_cast<size_t>(std::max(num_notes, 0)));
+            chord.notes.assign(source.notes.begin(), source.notes.begin() + count);
+            std::sort(chord.notes.begin(), chord.notes.end());
+        }
+    }
+    return result;
+}
+
+// entry layout (little-endian): magic, version, depth, length of the parameters, the parameters, the input size,
+// the number of channels, then per channel the number of segments and per segment start, duration,
+// the number of notes and their frequencies from the strongest
+bool ResultCache::load(const std::filesystem::path& path, const std::string& parameters, uint64_t input_size, int num_notes, channel_field& ranked) const{
+    MappedFile file(path.string());
+    if (!file.is_open()) return false;
+    const uint8_t* p = file.data();
+    const uint8_t* end = p + file.size();
+    auto read = [&](void* out, size_t size){
+        if (static_cast<size_t>(end - p) < size) return false;
+        std::memcpy(out, p, size);
+        p += size;
+        return true;
+    };
+
+    char file_magic[4];
+    uint32_t file_version, file_depth, parameters_size;
+    if (!read(file_magic, 4) || std::memcmp(file_magic, magic, 4) != 0) return false;
+    if (!read(&file_version, 4) || file_version != version) return false;
+    if (!read(&file_depth, 4) || static_cast<int>(file_depth) < num_notes) return false;
+    if (!read(&parameters_size, 4) || parameters_size != parameters.size() || static_cast<size_t>(end - p) < parameters_size) return false;
+    if (std::memcmp(p, parameters.data(), parameters_size) != 0) return false;
+    p += parameters_size;
+
+    uint64_t file_input_size, num_channels;
+    if (!read(&file_input_size, 8) || file_input_size != input_size) return false;
+    if (!read(&num_channels, 8) || num_channels > 65535) return false;
+    ranked.assign(num_channels, channel_type());
+    for (channel_type& channel : ranked){
+        uint64_t num_segments;
+        if (!read(&num_segments, 8) || num_segments > static_cast<uint64_t>(end - p)) return false;
+        channel.resize(num_segments);
+        for (segment_chord& chord : channel){
+            uint32_t count;
+            if (!read(&chord.start, 8) || !read(&chord.duration, 8) || !read(&count, 4) || count > file_depth) return false;
+            chord.notes.reserve(count);
+            for (uint32_t k = 0; k<count; k++){
+                double freq;
+                if (!read(&freq, 8)) return false;
+                chord.notes.emplace_back(freq);
+            }
+        }
+    }
+    return p == end;
+}
+
+void ResultCache::store(const std::filesystem::path& path, const std::string& parameters, uint64_t input_size, int stored_depth, const channel_field& ranked) const{
+    std::string bytes;
+    auto write = [&](const void* data, size_t size){bytes.append(static_cast<const char*>(data), size);};
+    uint32_t file_depth = stored_depth, parameters_size = parameters.size();
+    uint64_t num_channels = ranked.size();
+    write(magic, 4);
+    write(&version, 4);
+    write(&file_depth, 4);
+    write(&parameters_size, 4);
+    write(parameters.data(), parameters.size());
+    write(&input_size, 8);
+    write(&num_channels, 8);
+    for (const channel_type& channel : ranked){
+        uint64_t num_segments = channel.size();
+        write(&num_segments, 8);
+        for (const segment_chord& chord : channel){
+            uint32_t count = chord.notes.size();
+            write(&chord.start, 8);
+            write(&chord.duration, 8);
+            write(&count, 4);
+            for (const NoteClassifier& note : chord.notes) write(&note.freq, 8);
+        }
+    }
+
+    // written under a unique name and renamed, so that concurrent runs never read a partial entry
+    // a failure only means the next run analyzes the file again
+    std::filesystem::path temporary = path;
+    temporary += ".tmp" + std::to_string(std::random_device()());
+    {
+        std::ofstream out(temporary, std::ios::out | std::ios::binary);
+        out.write(bytes.data(), static_cast<std::streamsize>(bytes.size()));
+        if (!out) return;
+    }
+    std::error_code error;
+    std::filesystem::rename(temporary, path, error);
+    if (error) std::filesystem::remove(temporary, error);
+}
+
+void ResultCache::evict() const{
+    struct Entry {
+        std::filesystem::path path;
+        std::filesystem::file_time_type used;
+        uint64_t size;
+    };
+    std::vector<Entry> entries;
+    uint64_t total = 0;
+    std::error_code error;
+    for (const auto& item : std::filesystem::directory_iterator(directory, error)){
+        if (!item.is_regular_file(error) || item.path().extension() != extension) continue;
+        Entry entry{item.path(), item.last_write_time(error), item.file_size(error)};
+        if (error) continue;
+        total += entry.size;
+        entries.push_back(entry);
+    }
+    if (total <= max_bytes) return;
+
+    std::sort(entries.begin(), entries.end(), [](const Entry& a, const Entry& b){return a.used < b.used;});
+    for (const Entry& entry : entries){
+        if (total <= max_bytes) break;
+        if (std::filesystem::remove(entry.path, error)) total -= entry.size;
+    }
+}
+
+#endif //PROJECT_RESULT_CACHE_H
@@ -0,0 +1,20 @@
+//
+// Created by Samuel Longauer on 17/10/2026.
+//
+
+#ifndef PROJECT_SEGMENT_CHORD_H
+#define PROJECT_SEGMENT_CHORD_H
+
+#include <vector>
+#include "note_classifier.h"
+
+// result of the analysis of one segment (or one STFT frame) of a channel
+struct segment_chord {
+    std::vector<NoteClassifier> notes; // ordered by frequency
+    double duration = 0; // length of the segment in seconds
+    double start = 0; // offset of the segment from the beginning of the recording in seconds
+};
+
+typedef std::vector<segment_chord> channel_type;
+
+#endif //PROJECT_SEGMENT_CHORD_H
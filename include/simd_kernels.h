@@ -0,0 +1,715 @@
+//
+// Created by Samuel Longauer on 17/10/2026.
+//
+
+#ifndef PROJECT_SIMD_KERNELS_H
+#define PROJECT_SIMD_KERNELS_H
+
+#include <complex>
+#include <cstdint>
+#include <cstddef>
+#include <cmath>
+#include <cstring>
+#include <algorithm>
+#include <type_traits>
+
+// the inner loops of the spectral pipeline (conversion and windowing, magnitudes, power spectral density, peak scan, fft butterflies,
+// the decimation filter)
+// every kernel has a portable scalar version, on x86 the AVX2 or SSE3 version is picked once at runtime
+// complex values are processed in their interleaved (re, im) std::complex layout
+
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#define AUDIO_TRANSCRIBER_X86_SIMD 1
+#include <immintrin.h>
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#define TARGET_SSE3 __attribute__((target("sse3")))
+#endif
+
+enum class SimdLevel {scalar, sse3, avx2};
+
+SimdLevel detectSimdLevel(){
+#ifdef AUDIO_TRANSCRIBER_X86_SIMD
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) return SimdLevel::avx2;
+    if (__builtin_cpu_supports("sse3")) return SimdLevel::sse3;
+#endif
+    return SimdLevel::scalar;
+}
+
+const char* simdLevelName(SimdLevel level){
+    switch (level){
+        case SimdLevel::avx2: return "avx2";
+        case SimdLevel::sse3: return "sse3";
+        default: return "scalar";
+    }
+}
+
+
+// scalar kernels - also used for the tails the vector versions leave over
+
+template<typename T>
+void scalarMultiply(T* data, const T* factors, size_t n){
+    for (size_t i = 0; i<n; i++) data[i] *= factors[i];
+}
+
+// stored samples (int, int16_t or float) converted to T and windowed in one pass
+template<typename S, typename T>
+void scalarWindowSamples(const S* in, const T* window, T* out, size_t n){
+    for (size_t i = 0; i<n; i++) out[i] = static_cast<T>(in[i])*window[i];
+}
+
+template<typename T>
+void scalarMagnitudes(const std::complex<T>* in, T* out, size_t n){
+    for (size_t i = 0; i<n; i++){
+        T re = in[i].real(), im = in[i].imag();
+        out[i] = std::sqrt(re*re + im*im);
+    }
+}
+
+template<typename T>
+void scalarScaledNorms(const std::complex<T>* in, T* out, size_t n, T scale){
+    for (size_t i = 0; i<n; i++){
+        T re = in[i].real(), im = in[i].imag();
+        out[i] = (re*re + im*im)*scale;
+    }
+}
+
+template<typename T>
+T scalarDot(const T* a, const T* b, size_t n){
+    T result = 0;
+    for (size_t i = 0; i<n; i++) result += a[i]*b[i];
+    return result;
+}
+
+template<typename T>
+T scalarMaxValue(const T* in, size_t n){
+    T result = 0;
+    for (size_t i = 0; i<n; i++) result = std::max(result, in[i]);
+    return result;
+}
+
+// indices i from [begin, end) with in[i-1] < in[i] > in[i+1], the caller guarantees 1 <= begin and end <= n-1
+template<typename T>
+size_t scalarLocalMaxima(const T* in, size_t begin, size_t end, uint32_t* out){
+    size_t count = 0;
+    for (size_t i = begin; i<end; i++){
+        if (in[i-1] < in[i] && in[i] > in[i+1]) out[count++] = static_cast<uint32_t>(i);
+    }
+    return count;
+}
+
+template<typename T>
+inline std::complex<T> complexMultiply(std::complex<T> a, std::complex<T> b){
+    // plain formula, std::complex multiplication carries the slow inf/nan recovery path
+    return {a.real()*b.real() - a.imag()*b.imag(), a.real()*b.imag() + a.imag()*b.real()};
+}
+
+// radix-2 butterflies of one block: t = w[k]*b[k], b[k] = a[k]-t, a[k] = a[k]+t
+template<typename T>
+void scalarButterflies(std::complex<T>* a, std::complex<T>* b, const std::complex<T>* w, size_t n){
+    for (size_t k = 0; k<n; k++){
+        std::complex<T> t = complexMultiply(w[k], b[k]);
+        b[k] = a[k] - t;
+        a[k] += t;
+    }
+}
+
+// count radix-4 stockham butterflies sharing the twiddles w[0..2]
+// inputs are read from in[r + j*in_step], outputs written to out[r + k*out_step]
+template<typename T>
+void scalarRadix4(const std::complex<T>* in, size_t in_step, std::complex<T>* out, size_t out_step, const std::complex<T>* w, size_t count){
+    for (size_t r = 0; r<count; r++){
+        std::complex<T> a0 = in[r], a1 = in[r+in_step], a2 = in[r+2*in_step], a3 = in[r+3*in_step];
+        std::complex<T> t0 = a0 + a2, t1 = a0 - a2, t2 = a1 + a3;
+        std::complex<T> t3 = std::complex<T>((a1 - a3).imag(), -(a1 - a3).real()); // -i*(a1-a3)
+        out[r] = t0 + t2;
+        out[r+out_step] = complexMultiply(t1 + t3, w[0]);
+        out[r+2*out_step] = complexMultiply(t0 - t2, w[1]);
+        out[r+3*out_step] = complexMultiply(t1 - t3, w[2]);
+    }
+}
+
+
+#ifdef AUDIO_TRANSCRIBER_X86_SIMD
+
+// AVX2 kernels - one register holds 4 doubles / 8 floats, i.e. 2 / 4 complex values
+
+TARGET_AVX2 inline __m256d avx2ComplexMultiply(__m256d a, __m256d w){
+    __m256d w_re = _mm256_movedup_pd(w);
+    __m256d w_im = _mm256_permute_pd(w, 0xF);
+    __m256d a_swapped = _mm256_permute_pd(a, 0x5);
+    return _mm256_addsub_pd(_mm256_mul_pd(a, w_re), _mm256_mul_pd(a_swapped, w_im));
+}
+
+TARGET_AVX2 inline __m256 avx2ComplexMultiply(__m256 a, __m256 w){
+    __m256 w_re = _mm256_moveldup_ps(w);
+    __m256 w_im = _mm256_movehdup_ps(w);
+    __m256 a_swapped = _mm256_permute_ps(a, 0xB1);
+    return _mm256_addsub_ps(_mm256_mul_ps(a, w_re), _mm256_mul_ps(a_swapped, w_im));
+}
+
+TARGET_AVX2 void avx2Multiply(double* data, const double* factors, size_t n){
+    size_t i = 0;
+    for (; i+4<=n; i+=4) _mm256_storeu_pd(data+i, _mm256_mul_pd(_mm256_loadu_pd(data+i), _mm256_loadu_pd(factors+i)));
+    scalarMultiply(data+i, factors+i, n-i);
+}
+
+TARGET_AVX2 void avx2Multiply(float* data, const float* factors, size_t n){
+    size_t i = 0;
+    for (; i+8<=n; i+=8) _mm256_storeu_ps(data+i, _mm256_mul_ps(_mm256_loadu_ps(data+i), _mm256_loadu_ps(factors+i)));
+    scalarMultiply(data+i, factors+i, n-i);
+}
+
+TARGET_AVX2 void avx2WindowSamples(const int* in, const double* window, double* out, size_t n){
+    size_t i = 0;
+    for (; i+4<=n; i+=4){
+        __m256d x = _mm256_cvtepi32_pd(_mm_loadu_si128(reinterpret_cast<const __m128i*>(in+i)));
+        _mm256_storeu_pd(out+i, _mm256_mul_pd(x, _mm256_loadu_pd(window+i)));
+    }
+    scalarWindowSamples(in+i, window+i, out+i, n-i);
+}
+
+TARGET_AVX2 void avx2WindowSamples(const int* in, const float* window, float* out, size_t n){
+    size_t i = 0;
+    for (; i+8<=n; i+=8){
+        __m256 x = _mm256_cvtepi32_ps(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(in+i)));
+        _mm256_storeu_ps(out+i, _mm256_mul_ps(x, _mm256_loadu_ps(window+i)));
+    }
+    scalarWindowSamples(in+i, window+i, out+i, n-i);
+}
+
+TARGET_AVX2 void avx2WindowSamples(const int16_t* in, const double* window, double* out, size_t n){
+    size_t i = 0;
+    for (; i+4<=n; i+=4){
+        __m256d x = _mm256_cvtepi32_pd(_mm_cvtepi16_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(in+i))));
+        _mm256_storeu_pd(out+i, _mm256_mul_pd(x, _mm256_loadu_pd(window+i)));
+    }
+    scalarWindowSamples(in+i, window+i, out+i, n-i);
+}
+
+TARGET_AVX2 void avx2WindowSamples(const int16_t* in, const float* window, float* out, size_t n){
+    size_t i = 0;
+    for (; i+8<=n; i+=8){
+        __m256 x = _mm256_cvtepi32_ps(_mm256_cvtepi16_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(in+i))));
+        _mm256_storeu_ps(out+i, _mm256_mul_ps(x, _mm256_loadu_ps(window+i)));
+    }
+    scalarWindowSamples(in+i, window+i, out+i, n-i);
+}
+
+TARGET_AVX2 void avx2WindowSamples(const float* in, const double* window, double* out, size_t n){
+    size_t i = 0;
+    for (; i+4<=n; i+=4){
+        __m256d x = _mm256_cvtps_pd(_mm_loadu_ps(in+i));
+        _mm256_storeu_pd(out+i, _mm256_mul_pd(x, _mm256_loadu_pd(window+i)));
+    }
+    scalarWindowSamples(in+i, window+i, out+i, n-i);
+}
+
+TARGET_AVX2 void avx2WindowSamples(const float* in, const float* window, float* out, size_t n){
+    size_t i = 0;
+    for (; i+8<=n; i+=8) _mm256_storeu_ps(out+i, _mm256_mul_ps(_mm256_loadu_ps(in+i), _mm256_loadu_ps(window+i)));
+    scalarWindowSamples(in+i, window+i, out+i, n-i);
+}
+
+// squared magnitudes of 4 (double) / 8 (float) consecutive complex values in order
+TARGET_AVX2 inline __m256d avx2Norms(const std::complex<double>* in){
+    __m256d lo = _mm256_loadu_pd(reinterpret_cast<const double*>(in));
+    __m256d hi = _mm256_loadu_pd(reinterpret_cast<const double*>(in+2));
+    __m256d sums = _mm256_hadd_pd(_mm256_mul_pd(lo, lo), _mm256_mul_pd(hi, hi)); // n0 n2 n1 n3
+    return _mm256_permute4x64_pd(sums, 0xD8);
+}
+
+TARGET_AVX2 inline __m256 avx2Norms(const std::complex<float>* in){
+    __m256 lo = _mm256_loadu_ps(reinterpret_cast<const float*>(in));
+    __m256 hi = _mm256_loadu_ps(reinterpret_cast<const float*>(in+4));
+    __m256 sums = _mm256_hadd_ps(_mm256_mul_ps(lo, lo), _mm256_mul_ps(hi, hi)); // n0 n1 n4 n5 n2 n3 n6 n7
+    return _mm256_castpd_ps(_mm256_permute4x64_pd(_mm256_castps_pd(sums), 0xD8));
+}
+
+TARGET_AVX2 void avx2Magnitudes(const std::complex<double>* in, double* out, size_t n){
+    size_t i = 0;
+    for (; i+4<=n; i+=4) _mm256_storeu_pd(out+i, _mm256_sqrt_pd(avx2Norms(in+i)));
+    scalarMagnitudes(in+i, out+i, n-i);
+}
+
+TARGET_AVX2 void avx2Magnitudes(const std::complex<float>* in, float* out, size_t n){
+    size_t i = 0;
+    for (; i+8<=n; i+=8) _mm256_storeu_ps(out+i, _mm256_sqrt_ps(avx2Norms(in+i)));
+    scalarMagnitudes(in+i, out+i, n-i);
+}
+
+TARGET_AVX2 void avx2ScaledNorms(const std::complex<double>* in, double* out, size_t n, double scale){
+    __m256d factor = _mm256_set1_pd(scale);
+    size_t i = 0;
+    for (; i+4<=n; i+=4) _mm256_storeu_pd(out+i, _mm256_mul_pd(avx2Norms(in+i), factor));
+    scalarScaledNorms(in+i, out+i, n-i, scale);
+}
+
+TARGET_AVX2 void avx2ScaledNorms(const std::complex<float>* in, float* out, size_t n, float scale){
+    __m256 factor = _mm256_set1_ps(scale);
+    size_t i = 0;
+    for (; i+8<=n; i+=8) _mm256_storeu_ps(out+i, _mm256_mul_ps(avx2Norms(in+i), factor));
+    scalarScaledNorms(in+i, out+i, n-i, scale);
+}
+
+TARGET_AVX2 double avx2Dot(const double* a, const double* b, size_t n){
+    __m256d acc0 = _mm256_setzero_pd(), acc1 = _mm256_setzero_pd();
+    size_t i = 0;
+    for (; i+8<=n; i+=8){
+        acc0 = _mm256_add_pd(acc0, _mm256_mul_pd(_mm256_loadu_pd(a+i), _mm256_loadu_pd(b+i)));
+        acc1 = _mm256_add_pd(acc1, _mm256_mul_pd(_mm256_loadu_pd(a+i+4), _mm256_loadu_pd(b+i+4)));
+    }
+    double lanes[4];
+    _mm256_storeu_pd(lanes, _mm256_add_pd(acc0, acc1));
+    return (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]) + scalarDot(a+i, b+i, n-i);
+}
+
+TARGET_AVX2 float avx2Dot(const float* a, const float* b, size_t n){
+    __m256 acc0 = _mm256_setzero_ps(), acc1 = _mm256_setzero_ps();
+    size_t i = 0;
+    for (; i+16<=n; i+=16){
+        acc0 = _mm256_add_ps(acc0, _mm256_mul_ps(_mm256_loadu_ps(a+i), _mm256_loadu_ps(b+i)));
+        acc1 = _mm256_add_ps(acc1, _mm256_mul_ps(_mm256_loadu_ps(a+i+8), _mm256_loadu_ps(b+i+8)));
+    }
+    float lanes[8];
+    _mm256_storeu_ps(lanes, _mm256_add_ps(acc0, acc1));
+    float result = 0;
+    for (float lane : lanes) result += lane;
+    return result + scalarDot(a+i, b+i, n-i);
+}
+
+TARGET_AVX2 double avx2MaxValue(const double* in, size_t n){
+    __m256d acc = _mm256_setzero_pd();
+    size_t i = 0;
+    for (; i+4<=n; i+=4) acc = _mm256_max_pd(acc, _mm256_loadu_pd(in+i));
+    double lanes[4];
+    _mm256_storeu_pd(lanes, acc);
+    double result = std::max(std::max(lanes[0], lanes[1]), std::max(lanes[2], lanes[3]));
+    return std::max(result, scalarMaxValue(in+i, n-i));
+}
+
+TARGET_AVX2 float avx2MaxValue(const float* in, size_t n){
+    __m256 acc = _mm256_setzero_ps();
+    size_t i = 0;
+    for (; i+8<=n; i+=8) acc = _mm256_max_ps(acc, _mm256_loadu_ps(in+i));
+    float lanes[8];
+    _mm256_storeu_ps(lanes, acc);
+    float result = *std::max_element(lanes, lanes+8);
+    return std::max(result, scalarMaxValue(in+i, n-i));
+}
+
+TARGET_AVX2 size_t avx2LocalMaxima(const double* in, size_t begin, size_t end, uint32_t* out){
+    size_t count = 0;
+    size_t i = begin;
+    for (; i+4<=end; i+=4){
+        __m256d prev = _mm256_loadu_pd(in+i-1), cur = _mm256_loadu_pd(in+i), next = _mm256_loadu_pd(in+i+1);
+        __m256d peak = _mm256_and_pd(_mm256_cmp_pd(prev, cur, _CMP_LT_OQ), _mm256_cmp_pd(cur, next, _CMP_GT_OQ));
+        for (int mask = _mm256_movemask_pd(peak); mask; mask &= mask-1){
+            out[count++] = static_cast<uint32_t>(i + __builtin_ctz(mask));
+        }
+    }
+    return count + scalarLocalMaxima(in, i, end, out+count);
+}
+
+TARGET_AVX2 size_t avx2LocalMaxima(const float* in, size_t begin, size_t end, uint32_t* out){
+    size_t count = 0;
+    size_t i = begin;
+    for (; i+8<=end; i+=8){
+        __m256 prev = _mm256_loadu_ps(in+i-1), cur = _mm256_loadu_ps(in+i), next = _mm256_loadu_ps(in+i+1);
+        __m256 peak = _mm256_and_ps(_mm256_cmp_ps(prev, cur, _CMP_LT_OQ), _mm256_cmp_ps(cur, next, _CMP_GT_OQ));
+        for (int mask = _mm256_movemask_ps(peak); mask; mask &= mask-1){
+            out[count++] = static_cast<uint32_t>(i + __builtin_ctz(mask));
+        }
+    }
+    return count + scalarLocalMaxima(in, i, end, out+count);
+}
+
+TARGET_AVX2 void avx2Butterflies(std::complex<double>* a, std::complex<double>* b, const std::complex<double>* w, size_t n){
+    size_t k = 0;
+    for (; k+2<=n; k+=2){
+        double* pa = reinterpret_cast<double*>(a+k);
+        double* pb = reinterpret_cast<double*>(b+k);
+        __m256d t = avx2ComplexMultiply(_mm256_loadu_pd(pb), _mm256_loadu_pd(reinterpret_cast<const double*>(w+k)));
+        __m256d va = _mm256_loadu_pd(pa);
+        _mm256_storeu_pd(pb, _mm256_sub_pd(va, t));
+        _mm256_storeu_pd(pa, _mm256_add_pd(va, t));
+    }
+    scalarButterflies(a+k, b+k, w+k, n-k);
+}
+
+TARGET_AVX2 void avx2Butterflies(std::complex<float>* a, std::complex<float>* b, const std::complex<float>* w, size_t n){
+    size_t k = 0;
+    for (; k+4<=n; k+=4){
+        float* pa = reinterpret_cast<float*>(a+k);
+        float* pb = reinterpret_cast<float*>(b+k);
+        __m256 t = avx2ComplexMultiply(_mm256_loadu_ps(pb), _mm256_loadu_ps(reinterpret_cast<const float*>(w+k)));
+        __m256 va = _mm256_loadu_ps(pa);
+        _mm256_storeu_ps(pb, _mm256_sub_ps(va, t));
+        _mm256_storeu_ps(pa, _mm256_add_ps(va, t));
+    }
+    scalarButterflies(a+k, b+k, w+k, n-k);
+}
+
+TARGET_AVX2 void avx2Radix4(const std::complex<double>* in, size_t in_step, std::complex<double>* out, size_t out_step, const std::complex<double>* w, size_t count){
+    const __m256d w1 = _mm256_broadcast_pd(reinterpret_cast<const __m128d*>(w));
+    const __m256d w2 = _mm256_broadcast_pd(reinterpret_cast<const __m128d*>(w+1));
+    const __m256d w3 = _mm256_broadcast_pd(reinterpret_cast<const __m128d*>(w+2));
+    const __m256d odd_sign = _mm256_set_pd(-0.0, 0.0, -0.0, 0.0);
+    size_t r = 0;
+    for (; r+2<=count; r+=2){
+        const double* pin = reinterpret_cast<const double*>(in+r);
+        double* pout = reinterpret_cast<double*>(out+r);
+        __m256d a0 = _mm256_loadu_pd(pin), a1 = _mm256_loadu_pd(pin+2*in_step);
+        __m256d a2 = _mm256_loadu_pd(pin+4*in_step), a3 = _mm256_loadu_pd(pin+6*in_step);
+        __m256d t0 = _mm256_add_pd(a0, a2), t1 = _mm256_sub_pd(a0, a2), t2 = _mm256_add_pd(a1, a3);
+        __m256d t3 = _mm256_xor_pd(_mm256_permute_pd(_mm256_sub_pd(a1, a3), 0x5), odd_sign); // -i*(a1-a3)
+        _mm256_storeu_pd(pout, _mm256_add_pd(t0, t2));
+        _mm256_storeu_pd(pout+2*out_step, avx2ComplexMultiply(_mm256_add_pd(t1, t3), w1));
+        _mm256_storeu_pd(pout+4*out_step, avx2ComplexMultiply(_mm256_sub_pd(t0, t2), w2));
+        _mm256_storeu_pd(pout+6*out_step, avx2ComplexMultiply(_mm256_sub_pd(t1, t3), w3));
+    }
+    scalarRadix4(in+r, in_step, out+r, out_step, w, count-r);
+}
+
+TARGET_AVX2 void avx2Radix4(const std::complex<float>* in, size_t in_step, std::complex<float>* out, size_t out_step, const std::complex<float>* w, size_t count){
+    const __m256 w1 = _mm256_castpd_ps(_mm256_broadcast_sd(reinterpret_cast<const double*>(w)));
+    const __m256 w2 = _mm256_castpd_ps(_mm256_broadcast_sd(reinterpret_cast<const double*>(w+1)));
+    const __m256 w3 = _mm256_castpd_ps(_mm256_broadcast_sd(reinterpret_cast<const double*>(w+2)));
+    const __m256 odd_sign = _mm256_set_ps(-0.0f, 0.0f, -0.0f, 0.0f, -0.0f, 0.0f, -0.0f, 0.0f);
+    size_t r = 0;
+    for (; r+4<=count; r+=4){
+        const float* pin = reinterpret_cast<const float*>(in+r);
+        float* pout = reinterpret_cast<float*>(out+r);
+        __m256 a0 = _mm256_loadu_ps(pin), a1 = _mm256_loadu_ps(pin+2*in_step);
+        __m256 a2 = _mm256_loadu_ps(pin+4*in_step), a3 = _mm256_loadu_ps(pin+6*in_step);
+        __m256 t0 = _mm256_add_ps(a0, a2), t1 = _mm256_sub_ps(a0, a2), t2 = _mm256_add_ps(a1, a3);
+        __m256 t3 = _mm256_xor_ps(_mm256_permute_ps(_mm256_sub_ps(a1, a3), 0xB1), odd_sign); // -i*(a1-a3)
+        _mm256_storeu_ps(pout, _mm256_add_ps(t0, t2));
+        _mm256_storeu_ps(pout+2*out_step, avx2ComplexMultiply(_mm256_add_ps(t1, t3), w1));
+        _mm256_storeu_ps(pout+4*out_step, avx2ComplexMultiply(_mm256_sub_ps(t0, t2), w2));
+        _mm256_storeu_ps(pout+6*out_step, avx2ComplexMultiply(_mm256_sub_ps(t1, t3), w3));
+    }
+    scalarRadix4(in+r, in_step, out+r, out_step, w, count-r);
+}
+
+
+// SSE3 kernels - one register holds 2 doubles / 4 floats, i.e. 1 / 2 complex values
+
+TARGET_SSE3 inline __m128d sse3ComplexMultiply(__m128d a, __m128d w){
+    __m128d w_re = _mm_movedup_pd(w);
+    __m128d w_im = _mm_unpackhi_pd(w, w);
+    __m128d a_swapped = _mm_shuffle_pd(a, a, 0x1);
+    return _mm_addsub_pd(_mm_mul_pd(a, w_re), _mm_mul_pd(a_swapped, w_im));
+}
+
+TARGET_SSE3 inline __m128 sse3ComplexMultiply(__m128 a, __m128 w){
+    __m128 w_re = _mm_moveldup_ps(w);
+    __m128 w_im = _mm_movehdup_ps(w);
+    __m128 a_swapped = _mm_shuffle_ps(a, a, 0xB1);
+    return _mm_addsub_ps(_mm_mul_ps(a, w_re), _mm_mul_ps(a_swapped, w_im));
+}
+
+TARGET_SSE3 void sse3Multiply(double* data, const double* factors, size_t n){
+    size_t i = 0;
+    for (; i+2<=n; i+=2) _mm_storeu_pd(data+i, _mm_mul_pd(_mm_loadu_pd(data+i), _mm_loadu_pd(factors+i)));
+    scalarMultiply(data+i, factors+i, n-i);
+}
+
+TARGET_SSE3 void sse3Multiply(float* data, const float* factors, size_t n){
+    size_t i = 0;
+    for (; i+4<=n; i+=4) _mm_storeu_ps(data+i, _mm_mul_ps(_mm_loadu_ps(data+i), _mm_loadu_ps(factors+i)));
+    scalarMultiply(data+i, factors+i, n-i);
+}
+
+TARGET_SSE3 void sse3WindowSamples(const int* in, const double* window, double* out, size_t n){
+    size_t i = 0;
+    for (; i+2<=n; i+=2){
+        __m128d x = _mm_cvtepi32_pd(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(in+i)));
+        _mm_storeu_pd(out+i, _mm_mul_pd(x, _mm_loadu_pd(window+i)));
+    }
+    scalarWindowSamples(in+i, window+i, out+i, n-i);
+}
+
+TARGET_SSE3 void sse3WindowSamples(const int* in, const float* window, float* out, size_t n){
+    size_t i = 0;
+    for (; i+4<=n; i+=4){
+        __m128 x = _mm_cvtepi32_ps(_mm_loadu_si128(reinterpret_cast<const __m128i*>(in+i)));
+        _mm_storeu_ps(out+i, _mm_mul_ps(x, _mm_loadu_ps(window+i)));
+    }
+    scalarWindowSamples(in+i, window+i, out+i, n-i);
+}
+
+TARGET_SSE3 inline __m128i sse3Widen16(__m128i x){
+    return _mm_srai_epi32(_mm_unpacklo_epi16(x, x), 16); // the low 4 int16_t sign-extended to int32_t (no SSE4.1 needed)
+}
+
+TARGET_SSE3 void sse3WindowSamples(const int16_t* in, const double* window, double* out, size_t n){
+    size_t i = 0;
+    for (; i+2<=n; i+=2){
+        int32_t pair;
+        std::memcpy(&pair, in+i, sizeof(pair));
+        __m128d x = _mm_cvtepi32_pd(sse3Widen16(_mm_cvtsi32_si128(pair)));
+        _mm_storeu_pd(out+i, _mm_mul_pd(x, _mm_loadu_pd(window+i)));
+    }
+    scalarWindowSamples(in+i, window+i, out+i, n-i);
+}
+
+TARGET_SSE3 void sse3WindowSamples(const int16_t* in, const float* window, float* out, size_t n){
+    size_t i = 0;
+    for (; i+4<=n; i+=4){
+        __m128 x = _mm_cvtepi32_ps(sse3Widen16(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(in+i))));
+        _mm_storeu_ps(out+i, _mm_mul_ps(x, _mm_loadu_ps(window+i)));
+    }
+    scalarWindowSamples(in+i, window+i, out+i, n-i);
+}
+
+TARGET_SSE3 void sse3WindowSamples(const float* in, const double* window, double* out, size_t n){
+    size_t i = 0;
+    for (; i+2<=n; i+=2){
+        __m128d x = _mm_cvtps_pd(_mm_castsi128_ps(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(in+i))));
+        _mm_storeu_pd(out+i, _mm_mul_pd(x, _mm_loadu_pd(window+i)));
+    }
+    scalarWindowSamples(in+i, window+i, out+i, n-i);
+}
+
+TARGET_SSE3 void sse3WindowSamples(const float* in, const float* window, float* out, size_t n){
+    size_t i = 0;
+    for (; i+4<=n; i+=4) _mm_storeu_ps(out+i, _mm_mul_ps(_mm_loadu_ps(in+i), _mm_loadu_ps(window+i)));
+    scalarWindowSamples(in+i, window+i, out+i, n-i);
+}
+
+TARGET_SSE3 inline __m128d sse3Norms(const std::complex<double>* in){
+    __m128d lo = _mm_loadu_pd(reinterpret_cast<const double*>(in));
+    __m128d hi = _mm_loadu_pd(reinterpret_cast<const double*>(in+1));
+    return _mm_hadd_pd(_mm_mul_pd(lo, lo), _mm_mul_pd(hi, hi));
+}
+
+TARGET_SSE3 inline __m128 sse3Norms(const std::complex<float>* in){
+    __m128 lo = _mm_loadu_ps(reinterpret_cast<const float*>(in));
+    __m128 hi = _mm_loadu_ps(reinterpret_cast<const float*>(in+2));
+    return _mm_hadd_ps(_mm_mul_ps(lo, lo), _mm_mul_ps(hi, hi));
+}
+
+TARGET_SSE3 void sse3Magnitudes(const std::complex<double>* in, double* out, size_t n){
+    size_t i = 0;
+    for (; i+2<=n; i+=2) _mm_storeu_pd(out+i, _mm_sqrt_pd(sse3Norms(in+i)));
+    scalarMagnitudes(in+i, out+i, n-i);
+}
+
+TARGET_SSE3 void sse3Magnitudes(const std::complex<float>* in, float* out, size_t n){
+    size_t i = 0;
+    for (; i+4<=n; i+=4) _mm_storeu_ps(out+i, _mm_sqrt_ps(sse3Norms(in+i)));
+    scalarMagnitudes(in+i, out+i, n-i);
+}
+
+TARGET_SSE3 void sse3ScaledNorms(const std::complex<double>* in, double* out, size_t n, double scale){
+    __m128d factor = _mm_set1_pd(scale);
+    size_t i = 0;
+    for (; i+2<=n; i+=2) _mm_storeu_pd(out+i, _mm_mul_pd(sse3Norms(in+i), factor));
+    scalarScaledNorms(in+i, out+i, n-i, scale);
+}
+
+TARGET_SSE3 void sse3ScaledNorms(const std::complex<float>* in, float* out, size_t n, float scale){
+    __m128 factor = _mm_set1_ps(scale);
+    size_t i = 0;
+    for (; i+4<=n; i+=4) _mm_storeu_ps(out+i, _mm_mul_ps(sse3Norms(in+i), factor));
+    scalarScaledNorms(in+i, out+i, n-i, scale);
+}
+
+TARGET_SSE3 double sse3Dot(const double* a, const double* b, size_t n){
+    __m128d acc = _mm_setzero_pd();
+    size_t i = 0;
+    for (; i+2<=n; i+=2) acc = _mm_add_pd(acc, _mm_mul_pd(_mm_loadu_pd(a+i), _mm_loadu_pd(b+i)));
+    double lanes[2];
+    _mm_storeu_pd(lanes, acc);
+    return lanes[0] + lanes[1] + scalarDot(a+i, b+i, n-i);
+}
+
+TARGET_SSE3 float sse3Dot(const float* a, const float* b, size_t n){
+    __m128 acc = _mm_setzero_ps();
+    size_t i = 0;
+    for (; i+4<=n; i+=4) acc = _mm_add_ps(acc, _mm_mul_ps(_mm_loadu_ps(a+i), _mm_loadu_ps(b+i)));
+    float lanes[4];
+    _mm_storeu_ps(lanes, acc);
+    return (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]) + scalarDot(a+i, b+i, n-i);
+}
+
+TARGET_SSE3 double sse3MaxValue(const double* in, size_t n){
+    __m128d acc = _mm_setzero_pd();
+    size_t i = 0;
+    for (; i+2<=n; i+=2) acc = _mm_max_pd(acc, _mm_loadu_pd(in+i));
+    double lanes[2];
+    _mm_storeu_pd(lanes, acc);
+    return std::max(std::max(lanes[0], lanes[1]), scalarMaxValue(in+i, n-i));
+}
+
+TARGET_SSE3 float sse3MaxValue(const float* in, size_t n){
+    __m128 acc = _mm_setzero_ps();
+    size_t i = 0;
+    for (; i+4<=n; i+=4) acc = _mm_max_ps(acc, _mm_loadu_ps(in+i));
+    float lanes[4];
+    _mm_storeu_ps(lanes, acc);
+    float result = std::max(std::max(lanes[0], lanes[1]), std::max(lanes[2], lanes[3]));
+    return std::max(result, scalarMaxValue(in+i, n-i));
+}
+
+TARGET_SSE3 size_t sse3LocalMaxima(const double* in, size_t begin, size_t end, uint32_t* out){
+    size_t count = 0;
+    size_t i = begin;
+    for (; i+2<=end; i+=2){
+        __m128d prev = _mm_loadu_pd(in+i-1), cur = _mm_loadu_pd(in+i), next = _mm_loadu_pd(in+i+1);
+        __m128d peak = _mm_and_pd(_mm_cmplt_pd(prev, cur), _mm_cmpgt_pd(cur, next));
+        for (int mask = _mm_movemask_pd(peak); mask; mask &= mask-1){
+            out[count++] = static_cast<uint32_t>(i + __builtin_ctz(mask));
+        }
+    }
+    return count + scalarLocalMaxima(in, i, end, out+count);
+}
+
+TARGET_SSE3 size_t sse3LocalMaxima(const float* in, size_t begin, size_t end, uint32_t* out){
+    size_t count = 0;
+    size_t i = begin;
+    for (; i+4<=end; i+=4){
+        __m128 prev = _mm_loadu_ps(in+i-1), cur = _mm_loadu_ps(in+i), next = _mm_loadu_ps(in+i+1);
+        __m128 peak = _mm_and_ps(_mm_cmplt_ps(prev, cur), _mm_cmpgt_ps(cur, next));
+        for (int mask = _mm_movemask_ps(peak); mask; mask &= mask-1){
+            out[count++] = static_cast<uint32_t>(i + __builtin_ctz(mask));
+        }
+    }
+    return count + scalarLocalMaxima(in, i, end, out+count);
+}
+
+TARGET_SSE3 void sse3Butterflies(std::complex<double>* a, std::complex<double>* b, const std::complex<double>* w, size_t n){
+    for (size_t k = 0; k<n; k++){
+        double* pa = reinterpret_cast<double*>(a+k);
+        double* pb = reinterpret_cast<double*>(b+k);
+        __m128d t = sse3ComplexMultiply(_mm_loadu_pd(pb), _mm_loadu_pd(reinterpret_cast<const double*>(w+k)));
+        __m128d va = _mm_loadu_pd(pa);
+        _mm_storeu_pd(pb, _mm_sub_pd(va, t));
+        _mm_storeu_pd(pa, _mm_add_pd(va, t));
+    }
+}
+
+TARGET_SSE3 void sse3Butterflies(std::complex<float>* a, std::complex<float>* b, const std::complex<float>* w, size_t n){
+    size_t k = 0;
+    for (; k+2<=n; k+=2){
+        float* pa = reinterpret_cast<float*>(a+k);
+        float* pb = reinterpret_cast<float*>(b+k);
+        __m128 t = sse3ComplexMultiply(_mm_loadu_ps(pb), _mm_loadu_ps(reinterpret_cast<const float*>(w+k)));
+        __m128 va = _mm_loadu_ps(pa);
+        _mm_storeu_ps(pb, _mm_sub_ps(va, t));
+        _mm_storeu_ps(pa, _mm_add_ps(va, t));
+    }
+    scalarButterflies(a+k, b+k, w+k, n-k);
+}
+
+TARGET_SSE3 void sse3Radix4(const std::complex<double>* in, size_t in_step, std::complex<double>* out, size_t out_step, const std::complex<double>* w, size_t count){
+    const __m128d w1 = _mm_loadu_pd(reinterpret_cast<const double*>(w));
+    const __m128d w2 = _mm_loadu_pd(reinterpret_cast<const double*>(w+1));
+    const __m128d w3 = _mm_loadu_pd(reinterpret_cast<const double*>(w+2));
+    const __m128d odd_sign = _mm_set_pd(-0.0, 0.0);
+    for (size_t r = 0; r<count; r++){
+        const double* pin = reinterpret_cast<const double*>(in+r);
+        double* pout = reinterpret_cast<double*>(out+r);
+        __m128d a0 = _mm_loadu_pd(pin), a1 = _mm_loadu_pd(pin+2*in_step);
+        __m128d a2 = _mm_loadu_pd(pin+4*in_step), a3 = _mm_loadu_pd(pin+6*in_step);
+        __m128d t0 = _mm_add_pd(a0, a2), t1 = _mm_sub_pd(a0, a2), t2 = _mm_add_pd(a1, a3);
+        __m128d d = _mm_sub_pd(a1, a3);
+        __m128d t3 = _mm_xor_pd(_mm_shuffle_pd(d, d, 0x1), odd_sign); // -i*(a1-a3)
+        _mm_storeu_pd(pout, _mm_add_pd(t0, t2));
+        _mm_storeu_pd(pout+2*out_step, sse3ComplexMultiply(_mm_add_pd(t1, t3), w1));
+        _mm_storeu_pd(pout+4*out_step, sse3ComplexMultiply(_mm_sub_pd(t0, t2), w2));
+        _mm_storeu_pd(pout+6*out_step, sse3ComplexMultiply(_mm_sub_pd(t1, t3), w3));
+    }
+}
+
+TARGET_SSE3 void sse3Radix4(const std::complex<float>* in, size_t in_step, std::complex<float>* out, size_t out_step, const std::complex<float>* w, size_t count){
+    const __m128 w1 = _mm_castpd_ps(_mm_load1_pd(reinterpret_cast<const double*>(w)));
+    const __m128 w2 = _mm_castpd_ps(_mm_load1_pd(reinterpret_cast<const double*>(w+1)));
+    const __m128 w3 = _mm_castpd_ps(_mm_load1_pd(reinterpret_cast<const double*>(w+2)));
+    const __m128 odd_sign = _mm_set_ps(-0.0f, 0.0f, -0.0f, 0.0f);
+    size_t r = 0;
+    for (; r+2<=count; r+=2){
+        const float* pin = reinterpret_cast<const float*>(in+r);
+        float* pout = reinterpret_cast<float*>(out+r);
+        __m128 a0 = _mm_loadu_ps(pin), a1 = _mm_loadu_ps(pin+2*in_step);
+        __m128 a2 = _mm_loadu_ps(pin+4*in_step), a3 = _mm_loadu_ps(pin+6*in_step);
+        __m128 t0 = _mm_add_ps(a0, a2), t1 = _mm_sub_ps(a0, a2), t2 = _mm_add_ps(a1, a3);
+        __m128 d = _mm_sub_ps(a1, a3);
+        __m128 t3 = _mm_xor_ps(_mm_shuffle_ps(d, d, 0xB1), odd_sign); // -i*(a1-a3)
+        _mm_storeu_ps(pout, _mm_add_ps(t0, t2));
+        _mm_storeu_ps(pout+2*out_step, sse3ComplexMultiply(_mm_add_ps(t1, t3), w1));
+        _mm_storeu_ps(pout+4*out_step, sse3ComplexMultiply(_mm_sub_ps(t0, t2), w2));
+        _mm_storeu_ps(pout+6*out_step, sse3ComplexMultiply(_mm_sub_ps(t1, t3), w3));
+    }
+    scalarRadix4(in+r, in_step, out+r, out_step, w, count-r);
+}
+
+#endif // AUDIO_TRANSCRIBER_X86_SIMD
+
+
+// table of the kernels for one sample type, filled once with the best versions the cpu supports
+template<typename T>
+struct SpectralKernels {
+    SimdLevel level = SimdLevel::scalar;
+    void (*multiply)(T* data, const T* factors, size_t n) = scalarMultiply<T>;
+    void (*windowSamples)(const int* in, const T* window, T* out, size_t n) = scalarWindowSamples<int, T>;
+    void (*windowSamples16)(const int16_t* in, const T* window, T* out, size_t n) = scalarWindowSamples<int16_t, T>;
+    void (*windowSamplesFloat)(const float* in, const T* window, T* out, size_t n) = scalarWindowSamples<float, T>;
+    void (*magnitudes)(const std::complex<T>* in, T* out, size_t n) = scalarMagnitudes<T>;
+    void (*scaledNorms)(const std::complex<T>* in, T* out, size_t n, T scale) = scalarScaledNorms<T>;
+    T (*dot)(const T* a, const T* b, size_t n) = scalarDot<T>;
+    T (*maxValue)(const T* in, size_t n) = scalarMaxValue<T>;
+    size_t (*localMaxima)(const T* in, size_t begin, size_t end, uint32_t* out) = scalarLocalMaxima<T>;
+    void (*butterflies)(std::complex<T>* a, std::complex<T>* b, const std::complex<T>* w, size_t n) = scalarButterflies<T>;
+    void (*radix4)(const std::complex<T>* in, size_t in_step, std::complex<T>* out, size_t out_step, const std::complex<T>* w, size_t count) = scalarRadix4<T>;
+
+    // the windowSamples kernel of the stored sample type S
+    template<typename S>
+    void window(const S* in, const T* window, T* out, size_t n) const{
+        if constexpr (std::is_same_v<S, int16_t>) windowSamples16(in, window, out, n);
+        else if constexpr (std::is_same_v<S, float>) windowSamplesFloat(in, window, out, n);
+        else windowSamples(in, window, out, n);
+    }
+
+    static const SpectralKernels& get(){
+        static const SpectralKernels kernels = select(detectSimdLevel());
+        return kernels;
+    }
+
+    static SpectralKernels select(SimdLevel level){
+        SpectralKernels k;
+#ifdef AUDIO_TRANSCRIBER_X86_SIMD
+        if (level == SimdLevel::avx2){
+            k.level = level;
+            k.multiply = avx2Multiply;
+            k.windowSamples = avx2WindowSamples;
+            k.windowSamples16 = avx2WindowSamples;
+            k.windowSamplesFloat = avx2WindowSamples;
+            k.magnitudes = avx2Magnitudes;
+            k.scaledNorms = avx2ScaledNorms;
+            k.dot = avx2Dot;
+            k.maxValue = avx2MaxValue;
+            k.localMaxima = avx2LocalMaxima;
+            k.butterflies = avx2Butterflies;
+            k.radix4 = avx2Radix4;
+        }else if (level == SimdLevel::sse3){
+            k.level = level;
+            k.multiply = sse3Multiply;
+            k.windowSamples = sse3WindowSamples;
+            k.windowSamples16 = sse3WindowSamples;
+            k.windowSamplesFloat = sse3WindowSamples;
+            k.magnitudes = sse3Magnitudes;
+            k.scaledNorms = sse3ScaledNorms;
+            k.dot = sse3Dot;
+            k.maxValue = sse3MaxValue;
+            k.localMaxima = sse3LocalMaxima;
+            k.butterflies = sse3Butterflies;
+            k.radix4 = sse3Radix4;
+        }
+#endif
+        return k;
+    }
+};
+
+#endif //PROJECT_SIMD_KERNELS_H
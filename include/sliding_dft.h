@@ -0,0 +1,104 @@
+//
+// Created by Samuel Longauer on 17/10/2026.
+//
+
+#ifndef PROJECT_SLIDING_DFT_H
+#define PROJECT_SLIDING_DFT_H
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <numbers>
+#include <vector>
+#include "note_classifier.h"
+
+// sliding DFT of one channel evaluated only at the 108 pitches C0..B8
+// pitch k sums the last window[k] samples, a constant-Q length of one semitone resolution (capped at max_window samples)
+// with which the neighbouring pitches fall on the zeros of its response
+// every sample costs one complex multiply-add per pitch and the power of every pitch is available after any sample,
+// the transform of a window is never recomputed
+class SlidingNoteBank {
+public:
+    SlidingNoteBank(int sample_rate, size_t max_window);
+
+    void process(const int* samples, size_t count);
+    // mean power of every pitch over its window (a sine of amplitude A at the pitch gives A*A/4)
+    void power(std::array<double, NUM_NOTES>& out) const;
+
+private:
+    static constexpr size_t block = 1024; // samples added to the history per pass over the pitches
+
+    std::vector<double> history; // the last samples, indexed by their position modulo the size
+    size_t mask;
+    uint64_t position = 0; // samples processed so far
+    std::array<size_t, NUM_NOTES> window;
+    // running sums, e^(-j w position) and its per-sample step, e^(j w window) that turns the phase of the
+    // added sample into the phase of the sample leaving the window
+    std::array<double, NUM_NOTES> sum_re{}, sum_im{}, phasor_re, phasor_im, step_re, step_im, wrap_re, wrap_im;
+};
+
+SlidingNoteBank::SlidingNoteBank(int sample_rate, size_t max_window){
+    const double q = 1.0/(HALF_STEP - 1);
+    size_t longest = 1;
+    for (int k = 0; k<NUM_NOTES; k++){
+        const double f = NoteClassifier::table[k];
+        window[k] = std::clamp<size_t>(static_cast<size_t>(std::lround(q*sample_rate/f)), 1, std::max<size_t>(max_window, 1));
+        longest = std::max(longest, window[k]);
+        const double w = 2*std::numbers::pi*f/sample_rate;
+        phasor_re[k] = 1;
+        phasor_im[k] = 0;
+        step_re[k] = std::cos(w);
+        step_im[k] = -std::sin(w);
+        wrap_re[k] = std::cos(w*static_cast<double>(window[k]));
+        wrap_im[k] = std::sin(w*static_cast<double>(window[k]));
+    }
+    size_t size = 1;
+    while (size < longest + block) size <<= 1;
+    history.assign(size, 0.0);
+    mask = size - 1;
+}
+
+void SlidingNoteBank::process(const int* samples, size_t count){
+    while (count > 0){
+        const size_t n = std::min(count, block);
+        for (size_t i = 0; i<n; i++) history[(position + i) & mask] = samples[i];
+
+        // S += e^(-j w t) * (x[t] - x[t - N] e^(j w N)), one pitch at a time so that its state stays in registers
+        for (int k = 0; k<NUM_NOTES; k++){
+            double s_re = sum_re[k], s_im = sum_im[k], p_re = phasor_re[k], p_im = phasor_im[k];
+            const double c_re = step_re[k], c_im = step_im[k], o_re = wrap_re[k], o_im = wrap_im[k];
+            const uint64_t lag = window[k];
+            for (size_t i = 0; i<n; i++){
+                const uint64_t t = position + i;
+                const double x = history[t & mask];
+                const double old = history[(t - lag) & mask]; // zeros before the window is filled
+                const double d_re = x - old*o_re;
+                const double d_im = -old*o_im;
+                s_re += p_re*d_re - p_im*d_im;
+                s_im += p_re*d_im + p_im*d_re;
+                const double next_re = p_re*c_re - p_im*c_im;
+                p_im = p_re*c_im + p_im*c_re;
+                p_re = next_re;
+            }
+            // the recursion drifts off the unit circle by rounding, renormalized once per block
+            const double norm = 1/std::sqrt(p_re*p_re + p_im*p_im);
+            sum_re[k] = s_re;
+            sum_im[k] = s_im;
+            phasor_re[k] = p_re*norm;
+            phasor_im[k] = p_im*norm;
+        }
+        position += n;
+        samples += n;
+        count -= n;
+    }
+}
+
+void SlidingNoteBank::power(std::array<double, NUM_NOTES>& out) const{
+    for (int k = 0; k<NUM_NOTES; k++){
+        const double n = static_cast<double>(window[k]);
+        out[k] = (sum_re[k]*sum_re[k] + sum_im[k]*sum_im[k])/(n*n);
+    }
+}
+
+#endif //PROJECT_SLIDING_DFT_H
@@ -0,0 +1,82 @@
+//
+// Created by Samuel Longauer on 17/10/2026.
+//
+
+#ifndef PROJECT_SPSC_RING_H
+#define PROJECT_SPSC_RING_H
+
+#include <atomic>
+#include <cstddef>
+#include <vector>
+
+// bounded queue between exactly one producer thread and one consumer thread, without locks
+// the slots are constructed once and reused: the producer fills the slot returned by write_slot() and publishes it
+// with push(), the consumer reads front() and releases it with pop() - neither side ever allocates or waits
+template<typename T>
+class SpscRing {
+public:
+    // capacity is rounded up to a power of two
+    explicit SpscRing(size_t capacity, const T& prototype = T());
+    SpscRing(const SpscRing&) = delete;
+    SpscRing& operator=(const SpscRing&) = delete;
+
+    size_t capacity() const {return slots_.size();}
+
+    // producer side, nullptr when the ring is full
+    T* write_slot();
+    void push();
+
+    // consumer side, nullptr when the ring is empty
+    T* front();
+    void pop();
+
+private:
+    static constexpr size_t line = 64; // head and tail on separate cache lines, the two threads do not share them
+
+    std::vector<T> slots_;
+    size_t mask_;
+    alignas(line) std::atomic<size_t> head_{0}; // next slot to read, written by the consumer
+    alignas(line) std::atomic<size_t> tail_{0}; // next slot to write, written by the producer
+    alignas(line) size_t cached_head_ = 0; // the producer's last view of head_
+    alignas(line) size_t cached_tail_ = 0; // the consumer's last view of tail_
+};
+
+template<typename T>
+SpscRing<T>::SpscRing(size_t capacity, const T& prototype){
+    size_t size = 1;
+    while (size < capacity) size <<= 1;
+    slots_.assign(size, prototype);
+    mask_ = size - 1;
+}
+
+template<typename T>
+T* SpscRing<T>::write_slot(){
+    size_t tail = tail_.load(std::memory_order_relaxed);
+    if (tail - cached_head_ == slots_.size()){
+        cached_head_ = head_.load(std::memory_order_acquire);
+        if (tail - cached_head_ == slots_.size()) return nullptr;
+    }
+    return &slots_[tail & mask_];
+}
+
+template<typename T>
+void SpscRing<T>::push(){
+    tail_.store(tail_.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+}
+
+template<typename T>
+T* SpscRing<T>::front(){
+    size_t head = head_.load(std::memory_order_relaxed);
+    if (head == cached_tail_){
+        cached_tail_ = tail_.load(std::memory_order_acquire);
+        if (head == cached_tail_) return nullptr;
+    }
+    return &slots_[head & mask_];
+}
+
+template<typename T>
+void SpscRing<T>::pop(){
+    head_.store(head_.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+}
+
+#endif //PROJECT_SPSC_RING_H
@@ -0,0 +1,161 @@
+//
+// Created by Samuel Longauer on 17/10/2026.
+//
+
+#ifndef PROJECT_THREAD_POOL_H
+#define PROJECT_THREAD_POOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// fixed set of workers with one task deque each - a worker takes its own tasks from the back
+// and steals from the front of the other deques once its own deque runs dry
+// the thread calling run() works as worker 0, so a pool of size n starts n-1 threads
+class WorkStealingPool {
+public:
+    explicit WorkStealingPool(unsigned num_workers);
+    ~WorkStealingPool();
+    WorkStealingPool(const WorkStealingPool&) = delete;
+    WorkStealingPool& operator=(const WorkStealingPool&) = delete;
+
+    unsigned size() const {return static_cast<unsigned>(queues_.size());}
+    // executes every task exactly once and returns after all of them finished
+    // the first exception thrown by a task is rethrown here (the remaining tasks still run)
+    void run(std::vector<std::function<void()>>& tasks);
+
+private:
+    struct TaskQueue {
+        std::mutex mutex;
+        std::deque<std::function<void()>*> tasks;
+    };
+
+    std::vector<std::unique_ptr<TaskQueue>> queues_;
+    std::vector<std::thread> threads_;
+
+    std::mutex run_mutex_; // one batch of tasks at a time
+    std::mutex mutex_;
+    std::condition_variable wake_;
+    std::condition_variable done_;
+    uint64_t generation_ = 0;
+    bool stop_ = false;
+    std::atomic<size_t> remaining_{0};
+    std::exception_ptr error_;
+
+    bool pop_(size_t self, std::function<void()>*& task);
+    void drain_(size_t self);
+    void thread_main_(size_t self);
+};
+
+WorkStealingPool::WorkStealingPool(unsigned num_workers){
+    if (num_workers == 0) num_workers = 1;
+    for (unsigned i = 0; i<num_workers; i++){
+        queues_.push_back(std::make_unique<TaskQueue>());
+    }
+    for (unsigned i = 1; i<num_workers; i++){
+        threads_.emplace_back(&WorkStealingPool::thread_main_, this, i);
+    }
+}
+
+WorkStealingPool::~WorkStealingPool(){
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stop_ = true;
+    }
+    wake_.notify_all();
+    for (std::thread& thread : threads_) thread.join();
+}
+
+void WorkStealingPool::run(std::vector<std::function<void()>>& tasks){
+    if (tasks.empty()) return;
+    std::lock_guard<std::mutex> run_lock(run_mutex_);
+
+    // the count is set before the first task is visible: a worker still draining after the previous batch
+    // can take a task of this one as soon as it is pushed
+    remaining_.store(tasks.size());
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        error_ = nullptr;
+    }
+    // dealing the tasks round robin, neighbouring tasks end up on different workers
+    for (size_t i = 0; i<tasks.size(); i++){
+        TaskQueue& queue = *queues_[i % queues_.size()];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        queue.tasks.push_front(&tasks[i]); // the owner pops from the back, so it runs its tasks in their original order
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        generation_++;
+    }
+    wake_.notify_all();
+
+    drain_(0);
+
+    std::exception_ptr error;
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        done_.wait(lock, [this]{return remaining_.load() == 0;});
+        error = error_;
+    }
+    if (error) std::rethrow_exception(error);
+}
+
+bool WorkStealingPool::pop_(size_t self, std::function<void()>*& task){
+    {
+        TaskQueue& own = *queues_[self];
+        std::lock_guard<std::mutex> lock(own.mutex);
+        if (!own.tasks.empty()){
+            task = own.tasks.back();
+            own.tasks.pop_back();
+            return true;
+        }
+    }
+    for (size_t k = 1; k<queues_.size(); k++){
+        TaskQueue& victim = *queues_[(self + k) % queues_.size()];
+        std::lock_guard<std::mutex> lock(victim.mutex);
+        if (!victim.tasks.empty()){
+            task = victim.tasks.front();
+            victim.tasks.pop_front();
+            return true;
+        }
+    }
+    return false;
+}
+
+void WorkStealingPool::drain_(size_t self){
+    std::function<void()>* task;
+    while (pop_(self, task)){
+        try {
+            (*task)();
+        }catch(...){
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (!error_) error_ = std::current_exception();
+        }
+        if (remaining_.fetch_sub(1) == 1){
+            std::lock_guard<std::mutex> lock(mutex_);
+            done_.notify_all();
+        }
+    }
+}
+
+void WorkStealingPool::thread_main_(size_t self){
+    uint64_t seen = 0;
+    for (;;){
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            wake_.wait(lock, [&]{return stop_ || generation_ != seen;});
+            if (stop_) return;
+            seen = generation_;
+        }
+        drain_(self);
+    }
+}
+
+#endif //PROJECT_THREAD_POOL_H
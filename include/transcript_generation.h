@@ -6,74 +6,393 @@
 #define PROJECT_TRANSCRIPT_GENERATION_H
 
 
-#include <iostream>
+#include <algorithm>
+#include <charconv>
+#include <cstdint>
+#include <cstring>
 #include <fstream>
+#include <span>
 #include <string>
-#include <sstream>
 #include <vector>
+#include <stdexcept>
 #include "note_classifier.h"
+#include "segment_chord.h"
+#include "mapped_file.h"
+#include "profiler.h"
 
-typedef std::pair<std::vector<NoteClassifier>, double> segment_chord;
-typedef std::vector<segment_chord> channel_type;
 
+enum class TranscriptFormat {text, csv, binary};
 
-std::string fixed_size_str(const std::string& st, int size){
-    std::string result;
-    for (int i = 0; i<size; i++){
-        if (i<st.length()){
-            result+=st[i];
-        }else{
-            result+=" ";
-        }
-    }
-    return result;
-}
+struct TranscriptOptions {
+    TranscriptFormat format = TranscriptFormat::text;
+    bool merge_repeats = false; // consecutive rows with the same notes in every channel become one longer row
+};
+
+// binary transcript - little-endian, every table starts at a multiple of 8 bytes, so the file can be memory-mapped and
+// its tables used in place:
+// header, one directory entry per channel, then the segment table and the note ids of each channel
+// the notes of a segment are notes[first_note, first_note + num_notes), ordered by frequency
+struct TranscriptHeader {
+    char magic[4]; // "ATRS"
+    uint32_t version;
+    uint32_t num_channels;
+    uint32_t reserved;
+};
+
+struct TranscriptChannelEntry {
+    uint64_t segments_offset; // from the beginning of the file
+    uint64_t num_segments;
+    uint64_t notes_offset;
+    uint64_t num_notes;
+};
+
+struct TranscriptSegment {
+    double start; // seconds
+    double duration;
+    uint32_t first_note;
+    uint32_t num_notes;
+};
+
+static_assert(sizeof(TranscriptHeader) == 16 && sizeof(TranscriptChannelEntry) == 32 && sizeof(TranscriptSegment) == 24);
+
+constexpr char TRANSCRIPT_MAGIC[4] = {'A', 'T', 'R', 'S'};
+constexpr uint32_t TRANSCRIPT_VERSION = 1;
+constexpr uint8_t NOTE_OUT_OF_RANGE = 255; // note id of a frequency outside of C0..B8, the others are NoteClassifier::index()
 
 
 // different rows represent different time segments
 // columns represent sets of notes for each of the channels for the given time segment(row)
 // the chords in each statement are ordered in an increasing order by their frequencies
 
-void generateTranscript(const std::string& transcriptFilePath, std::vector<channel_type> channels){    // creating a separate transcript for each channel
+// writes the transcript row by row, so that it can be produced while the analysis is still running
+// the text formats are rendered into a buffer that is written in large blocks, the binary format keeps its tables
+// in memory (24 bytes per segment and one byte per note) until close
+class TranscriptWriter {
+public:
+    TranscriptWriter(const std::string& transcriptFilePath, int num_channels, TranscriptOptions options = TranscriptOptions());
+    ~TranscriptWriter();
+    void write_row(const std::vector<segment_chord>& row); // one segment_chord per channel
+    void write_row(std::span<const segment_chord* const> row); // the same without gathering the chords first
+    // hands the rows rendered so far to the file right away (text and csv - a merged row is only finished by the next
+    // different one, the binary tables are written by close)
+    void flush();
+    // writes out everything that is still buffered, throws std::runtime_error when the transcript cannot be stored
+    void close();
+    uint64_t bytes_written() const {return written;}
 
+private:
     // transcript table proportions
-    int column1_len = 15;
-    int channel_col_len = 70;
-
-    std::fstream output(transcriptFilePath, std::ios::out);
-    output << "duration(s):   ";
-    for (int i = 0; i<channels.size(); i++){
-        std::ostringstream oss;
-        oss << "channel " << i+1;
-        std::string st = fixed_size_str(oss.str(), channel_col_len+column1_len);
-        output << st;
+    static const int column1_len = 15;
+    static const int channel_col_len = 70;
+    static const size_t flush_size = 1 << 16;
+
+    struct ChannelTables {
+        std::vector<TranscriptSegment> segments;
+        std::vector<uint8_t> notes;
+    };
+
+    TranscriptOptions options;
+    int num_channels;
+    std::ofstream output;
+    std::string buffer;
+    std::vector<const segment_chord*> gathered;
+    std::vector<segment_chord> pending; // the row being extended while repeats are merged
+    std::vector<const segment_chord*> pending_row;
+    bool has_pending = false;
+    std::vector<ChannelTables> tables;
+    uint64_t written = 0;
+
+    static bool same_notes(const segment_chord& a, const segment_chord& b);
+    static void append_pad(std::string& out, size_t start, size_t width); // pads or cuts out to start + width characters
+    static void append_number(std::string& out, double value);
+    static void append_note(std::string& out, const NoteClassifier& note);
+    void emit_row(std::span<const segment_chord* const> row);
+    void emit_pending();
+    void render_text(std::span<const segment_chord* const> row);
+    void render_csv(std::span<const segment_chord* const> row);
+    void flush_buffer();
+    void write_binary();
+};
+
+TranscriptWriter::TranscriptWriter(const std::string& transcriptFilePath, int num_channels, TranscriptOptions options) :
+        options(options), num_channels(num_channels), output(transcriptFilePath, std::ios::out | std::ios::binary), tables(num_channels){
+    if (!output.is_open()) throw std::runtime_error("The transcript file cannot be opened");
+    buffer.reserve(flush_size + 1024);
+    if (options.format == TranscriptFormat::text){
+        buffer += "duration(s):   ";
+        for (int i = 0; i<num_channels; i++){
+            size_t start = buffer.size();
+            buffer += "channel ";
+            buffer += std::to_string(i+1);
+            append_pad(buffer, start, channel_col_len+column1_len);
+        }
+        buffer += '\n';
+    }else if (options.format == TranscriptFormat::csv){
+        buffer += "start,duration";
+        for (int i = 0; i<num_channels; i++){
+            buffer += ",channel ";
+            buffer += std::to_string(i+1);
+        }
+        buffer += '\n';
     }
-    output << std::endl;
+}
 
-    int rows = (int)channels[0].size();
-    int columns = (int)channels.size();
+TranscriptWriter::~TranscriptWriter(){
+    try {
+        close();
+    }catch(...){
+        // an explicit close reports the failure, a writer destroyed by an exception stays silent
+    }
+}
 
-    for (int i = 0; i<rows; i++){
-        for (int j = 0; j<columns; j++){
+bool TranscriptWriter::same_notes(const segment_chord& a, const segment_chord& b){
+    if (a.notes.size() != b.notes.size()) return false;
+    for (size_t i = 0; i<a.notes.size(); i++){
+        if (a.notes[i].midi != b.notes[i].midi) return false;
+    }
+    return true;
+}
+
+void TranscriptWriter::append_pad(std::string& out, size_t start, size_t width){
+    out.resize(start + width, ' ');
+}
+
+// the shortest of the 6 significant digits a default formatted stream would print
+void TranscriptWriter::append_number(std::string& out, double value){
+    char digits[32];
+    auto result = std::to_chars(digits, digits + sizeof(digits), value, std::chars_format::general, 6);
+    out.append(digits, result.ptr);
+}
 
-            std::ostringstream oss;
-            std::vector<NoteClassifier> chord = channels[j][i].first;
-            double duration = channels[j][i].second;
+void TranscriptWriter::append_note(std::string& out, const NoteClassifier& note){
+    if (note.out_of_range) return;
+    out += note.name();
+    out += '(';
+    out += static_cast<char>('0' + note.octave());
+    out += ')';
+}
 
-            if (j == 0) oss << duration; else oss << " ";
-            output << fixed_size_str(oss.str(), column1_len);
-            oss.str(""); // resetting the oss object
+void TranscriptWriter::write_row(const std::vector<segment_chord>& row){
+    gathered.resize(row.size());
+    for (size_t j = 0; j<row.size(); j++) gathered[j] = &row[j];
+    write_row(gathered);
+}
 
+void TranscriptWriter::write_row(std::span<const segment_chord* const> row){
+    if (!output.is_open()) return;
+    ProfileTimer timer(ProfileStage::transcript);
+    uint64_t before = written;
+    if (!options.merge_repeats){
+        emit_row(row);
+        timer.add_bytes(written - before);
+        return;
+    }
 
-            for (auto&& x : chord){
-                oss << x.repr << " ";
+    bool repeat = has_pending && row.size() == pending.size();
+    for (size_t j = 0; repeat && j<row.size(); j++) repeat = same_notes(*row[j], pending[j]);
+    if (repeat){
+        for (size_t j = 0; j<row.size(); j++) pending[j].duration += row[j]->duration;
+        return;
+    }
+    if (has_pending) emit_pending();
+    timer.add_bytes(written - before);
+    pending.resize(row.size());
+    for (size_t j = 0; j<row.size(); j++){
+        pending[j].notes.assign(row[j]->notes.begin(), row[j]->notes.end());
+        pending[j].duration = row[j]->duration;
+        pending[j].start = row[j]->start;
+    }
+    has_pending = true;
+}
+
+void TranscriptWriter::emit_pending(){
+    pending_row.resize(pending.size());
+    for (size_t j = 0; j<pending.size(); j++) pending_row[j] = &pending[j];
+    emit_row(pending_row);
+    has_pending = false;
+}
+
+void TranscriptWriter::emit_row(std::span<const segment_chord* const> row){
+    switch (options.format){
+        case TranscriptFormat::text:
+            render_text(row);
+            break;
+        case TranscriptFormat::csv:
+            render_csv(row);
+            break;
+        case TranscriptFormat::binary:
+            for (int j = 0; j<num_channels && j<(int)row.size(); j++){
+                ChannelTables& channel = tables[j];
+                TranscriptSegment segment{row[j]->start, row[j]->duration, (uint32_t)channel.notes.size(), (uint32_t)row[j]->notes.size()};
+                channel.segments.push_back(segment);
+                for (auto&& note : row[j]->notes){
+                    channel.notes.push_back(note.out_of_range ? NOTE_OUT_OF_RANGE : static_cast<uint8_t>(note.index()));
+                }
             }
-            output << fixed_size_str(oss.str(), channel_col_len);
-            oss.str("");
-            if (j<columns-1) output << "|";
+            break;
+    }
+    if (buffer.size() >= flush_size) flush_buffer();
+}
+
+void TranscriptWriter::render_text(std::span<const segment_chord* const> row){
+    int columns = (int)row.size();
+    for (int j = 0; j<columns; j++){
+        size_t start = buffer.size();
+        if (j == 0) append_number(buffer, row[j]->duration); else buffer += ' ';
+        append_pad(buffer, start, column1_len);
+
+        start = buffer.size();
+        for (auto&& x : row[j]->notes){
+            append_note(buffer, x);
+            buffer += ' ';
+        }
+        append_pad(buffer, start, channel_col_len);
+        if (j<columns-1) buffer += '|';
+    }
+    buffer += '\n';
+}
+
+void TranscriptWriter::render_csv(std::span<const segment_chord* const> row){
+    if (row.empty()) return;
+    append_number(buffer, row[0]->start);
+    buffer += ',';
+    append_number(buffer, row[0]->duration);
+    for (const segment_chord* chord : row){
+        buffer += ',';
+        for (size_t i = 0; i<chord->notes.size(); i++){
+            if (i > 0) buffer += ' ';
+            append_note(buffer, chord->notes[i]);
+        }
+    }
+    buffer += '\n';
+}
+
+void TranscriptWriter::flush_buffer(){
+    written += buffer.size();
+    output.write(buffer.data(), (std::streamsize)buffer.size());
+    buffer.clear();
+}
+
+void TranscriptWriter::write_binary(){
+    auto align = [](uint64_t offset){return (offset + 7) & ~uint64_t(7);};
+    TranscriptHeader header{};
+    std::memcpy(header.magic, TRANSCRIPT_MAGIC, 4);
+    header.version = TRANSCRIPT_VERSION;
+    header.num_channels = (uint32_t)num_channels;
+
+    std::vector<TranscriptChannelEntry> directory(num_channels);
+    uint64_t offset = sizeof(TranscriptHeader) + num_channels*sizeof(TranscriptChannelEntry);
+    for (int j = 0; j<num_channels; j++){
+        directory[j].segments_offset = offset;
+        directory[j].num_segments = tables[j].segments.size();
+        offset += tables[j].segments.size()*sizeof(TranscriptSegment);
+        directory[j].notes_offset = offset;
+        directory[j].num_notes = tables[j].notes.size();
+        offset = align(offset + tables[j].notes.size());
+    }
+
+    written += offset;
+    output.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    output.write(reinterpret_cast<const char*>(directory.data()), (std::streamsize)(directory.size()*sizeof(TranscriptChannelEntry)));
+    const char zeros[8] = {};
+    for (int j = 0; j<num_channels; j++){
+        const ChannelTables& channel = tables[j];
+        output.write(reinterpret_cast<const char*>(channel.segments.data()), (std::streamsize)(channel.segments.size()*sizeof(TranscriptSegment)));
+        output.write(reinterpret_cast<const char*>(channel.notes.data()), (std::streamsize)channel.notes.size());
+        output.write(zeros, (std::streamsize)(align(channel.notes.size()) - channel.notes.size()));
+    }
+    tables.clear();
+}
+
+void TranscriptWriter::flush(){
+    if (!output.is_open() || options.format == TranscriptFormat::binary) return;
+    flush_buffer();
+    output.flush();
+}
+
+void TranscriptWriter::close(){
+    if (!output.is_open()) return;
+    ProfileTimer timer(ProfileStage::transcript);
+    uint64_t before = written;
+    if (has_pending) emit_pending();
+    if (options.format == TranscriptFormat::binary) write_binary();
+    flush_buffer();
+    timer.add_bytes(written - before);
+    output.close();
+    if (output.fail()) throw std::runtime_error("The transcript file cannot be written");
+}
+
+// memory-mapped binary transcript, the tables are used in place without any parsing
+class BinaryTranscript {
+public:
+    // throws std::runtime_error when the file cannot be read or is not a binary transcript
+    explicit BinaryTranscript(const std::string& filePath);
+
+    uint32_t num_channels() const {return header_->num_channels;}
+    std::span<const TranscriptSegment> segments(uint32_t channel) const;
+    std::span<const uint8_t> notes(uint32_t channel) const; // note ids, NoteClassifier::index() or NOTE_OUT_OF_RANGE
+    std::span<const uint8_t> notes(uint32_t channel, const TranscriptSegment& segment) const;
+
+private:
+    MappedFile file_;
+    const TranscriptHeader* header_ = nullptr;
+    const TranscriptChannelEntry* directory_ = nullptr;
+};
+
+BinaryTranscript::BinaryTranscript(const std::string& filePath) : file_(filePath){
+    if (!file_.is_open()) throw std::runtime_error("The transcript file cannot be opened");
+    auto invalid = [](){return std::runtime_error("The file is not a valid binary transcript");};
+    if (file_.size() < sizeof(TranscriptHeader)) throw invalid();
+    header_ = reinterpret_cast<const TranscriptHeader*>(file_.data());
+    if (std::memcmp(header_->magic, TRANSCRIPT_MAGIC, 4) != 0 || header_->version != TRANSCRIPT_VERSION) throw invalid();
+
+    uint64_t size = file_.size();
+    if (sizeof(TranscriptHeader) + uint64_t(header_->num_channels)*sizeof(TranscriptChannelEntry) > size) throw invalid();
+    directory_ = reinterpret_cast<const TranscriptChannelEntry*>(file_.data() + sizeof(TranscriptHeader));
+    for (uint32_t j = 0; j<header_->num_channels; j++){
+        const TranscriptChannelEntry& entry = directory_[j];
+        if (entry.segments_offset % 8 != 0 || entry.segments_offset > size ||
+            entry.num_segments > (size - entry.segments_offset)/sizeof(TranscriptSegment) ||
+            entry.notes_offset > size || entry.num_notes > size - entry.notes_offset) throw invalid();
+        for (const TranscriptSegment& segment : segments(j)){
+            if (uint64_t(segment.first_note) + segment.num_notes > entry.num_notes) throw invalid();
+        }
+    }
+}
+
+std::span<const TranscriptSegment> BinaryTranscript::segments(uint32_t channel) const{
+    const TranscriptChannelEntry& entry = directory_[channel];
+    return {reinterpret_cast<const TranscriptSegment*>(file_.data() + entry.segments_offset), entry.num_segments};
+}
+
+std::span<const uint8_t> BinaryTranscript::notes(uint32_t channel) const{
+    const TranscriptChannelEntry& entry = directory_[channel];
+    return {file_.data() + entry.notes_offset, entry.num_notes};
+}
+
+std::span<const uint8_t> BinaryTranscript::notes(uint32_t channel, const TranscriptSegment& segment) const{
+    return notes(channel).subspan(segment.first_note, segment.num_notes);
+}
+
+void generateTranscript(const std::string& transcriptFilePath, const std::vector<channel_type>& channels, TranscriptOptions options = TranscriptOptions()){    // creating a separate transcript for each channel
+    ProfileTimer timer(ProfileStage::transcript);
+    TranscriptWriter writer(transcriptFilePath, (int)channels.size(), options);
+
+    size_t rows = 0;
+    for (auto&& channel : channels) rows = std::max(rows, channel.size());
+    int columns = (int)channels.size();
+
+    // the row only refers to the chords, a channel that ended early shows empty chords
+    static const segment_chord silence;
+    std::vector<const segment_chord*> row(columns);
+    for (size_t i = 0; i<rows; i++){
+        for (int j = 0; j<columns; j++){
+            row[j] = i < channels[j].size() ? &channels[j][i] : &silence;
         }
-        output << std::endl;
+        writer.write_row(row);
     }
+    writer.close();
+    timer.add_bytes(writer.bytes_written());
 }
 
 
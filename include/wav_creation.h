@@ -11,17 +11,34 @@
 #include <string>
 #include <cmath>
 #include <utility>
+#include <stdexcept>
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <exception>
+#include <limits>
+#include <mutex>
+#include <thread>
 #include "note_classifier.h"
+#include "segment_chord.h"
+#include "additive_synth.h"
+#include "mapped_file.h"
+#include "profiler.h"
 
 using namespace std;
-typedef std::pair<std::vector<NoteClassifier>, double> segment_chord;
-typedef std::vector<segment_chord> channel_type;
+
+// sample encoding of the generated file
+enum class SampleFormat {pcm16, pcm24, float32};
+
+struct AudioOutputOptions {
+    SampleFormat format = SampleFormat::pcm16;
+    unsigned threads = 1; // channels rendered in parallel
+};
 
 class WaveGener {
 private:
     // RIFF chunk
     string chunk_id = "RIFF";
-    string chunk_size = "____";
     string format = "WAVE";
 
     // fmt sub-chunk
@@ -36,107 +53,247 @@ private:
 
     // Data sub-chunk
     const string subchunk2_id = "data";
-    const string subchunk2_size = "____";
+
+    static const size_t header_size = 44;
+
+    AudioOutputOptions options;
 
     static inline void write_as_bytes(ofstream& file, int value, int byte_size){
         file.write(reinterpret_cast<const char*>(&value), byte_size);
     }
+    static inline uint8_t* put_bytes(uint8_t* out, uint32_t value, int byte_size){
+        for (int i = 0; i<byte_size; i++) out[i] = static_cast<uint8_t>(value >> (8*i));
+        return out + byte_size;
+    }
+    static inline uint8_t* put_tag(uint8_t* out, const string& tag){
+        for (char c : tag) *out++ = static_cast<uint8_t>(c);
+        return out;
+    }
+
+    // the pcm is rendered block by block, so the memory use does not depend on the length of the output
+    static constexpr size_t block_frames = 4096;
+    std::vector<OscillatorBank> banks; // one synthesizer per channel
+    std::vector<std::vector<double>> block; // the current block of every channel
+    std::vector<uint8_t> bytes; // the current block interleaved and encoded
+
+    double peak_amplitude() const;
+    void reset_banks();
+    // stores count samples of one channel every stride bytes, clipped to the range of the sample format
+    void encode(const double* values, size_t count, uint8_t* out, size_t stride) const;
+    void render_channel(int channel, uint8_t* data, size_t total_frames); // the whole channel into its interleaved slots
+    void recreate_pcm(ofstream& wav, size_t frames); // renders and writes the next frames, channels without queued chords are silent
+    void header_bytes(uint8_t* out, uint32_t data_size) const;
+    void write_header(ofstream& wav);
+    void patch_sizes(ofstream& wav, int start_audio);
 
-    std::vector<std::vector<double>> recreate_pcm();
+    // state of the incremental output
+    ofstream stream;
+    int stream_start = 0;
 
 public:
     std::vector<channel_type> channels;
-    explicit WaveGener(std::vector<channel_type> channels) : channels(std::move(channels)){
+    explicit WaveGener(std::vector<channel_type> channels, AudioOutputOptions options = AudioOutputOptions()) : options(options), channels(std::move(channels)){
         this->num_channels = (int)(this->channels.size());
-        this->byte_rate = this->sample_rate*this->num_channels*(this->subchunk1_size/8);
-        this->block_align = this->num_channels*(this->subchunk1_size/8);
+        if (options.format == SampleFormat::pcm24) this->bits_per_sample = 24;
+        if (options.format == SampleFormat::float32){
+            this->bits_per_sample = 32;
+            this->audio_format = 3; // IEEE float
+        }
+        this->byte_rate = this->sample_rate*this->num_channels*(this->bits_per_sample/8);
+        this->block_align = this->num_channels*(this->bits_per_sample/8);
     }
+    // the size of the file is known from the durations of the chords, it is preallocated and filled through a memory map
     void write_to_file(const string& filePath);
+
+    // incremental output for the streaming analysis - rows (one chord per channel) are rendered and written as they come
+    void begin_stream(const string& filePath);
+    void append_row(const std::vector<segment_chord>& row);
+    void end_stream();
 };
 
-std::vector<std::vector<double>> WaveGener::recreate_pcm() {
-    std::vector<std::vector<double>> channels_values;
+// a few steps below full scale, as the integer formats always had
+double WaveGener::peak_amplitude() const{
+    if (options.format == SampleFormat::float32) return 1.0;
+    return pow(2, bits_per_sample-1) - 5;
+}
 
-    const double max_amplitude = pow(2, bits_per_sample-1) - 5;
+void WaveGener::reset_banks(){
+    banks.assign(num_channels, OscillatorBank(sample_rate, peak_amplitude()));
+    block.assign(num_channels, std::vector<double>(block_frames));
+}
 
-    for (auto&& chords : channels){
-        std::vector<double> values;
-        for (auto&& chord : chords){
-            std::vector<NoteClassifier>& frequencies = chord.first;
-            int num_freq = (int)frequencies.size();
-            double duration = chord.second;
-
-            int fade_out_length = min((int)(sample_rate*duration/20), 175);
-            int fade_out_start = (int)((sample_rate)*duration - fade_out_length);
-            int j = 1;
-
-            for (int i = 0; i<sample_rate*duration; i++){
-                double value = 0;
-                for (const auto& note : frequencies){
-                    double freq = note.freq;
-                    value+=sin(2*M_PI*i*freq/sample_rate);
-                }
-                if (i >= fade_out_start){
-                    values.push_back((value*max_amplitude/num_freq)*(1-static_cast<double>(j++)/fade_out_length));
-                }else if (i <= fade_out_length){
-                    values.push_back((value*max_amplitude/num_freq)*(static_cast<double>(i)/fade_out_length));
-                }else{
-                    values.push_back((value*max_amplitude/num_freq));
-                }
+void WaveGener::encode(const double* values, size_t count, uint8_t* out, size_t stride) const{
+    switch (options.format){
+        case SampleFormat::pcm16:
+            for (size_t i = 0; i<count; i++, out += stride){
+                long sample = lrint(std::clamp(values[i], -32768.0, 32767.0));
+                put_bytes(out, static_cast<uint32_t>(sample), 2);
+            }
+            break;
+        case SampleFormat::pcm24:
+            for (size_t i = 0; i<count; i++, out += stride){
+                long sample = lrint(std::clamp(values[i], -8388608.0, 8388607.0));
+                put_bytes(out, static_cast<uint32_t>(sample), 3);
+            }
+            break;
+        case SampleFormat::float32:
+            for (size_t i = 0; i<count; i++, out += stride){
+                float sample = static_cast<float>(std::clamp(values[i], -1.0, 1.0));
+                uint32_t bits;
+                memcpy(&bits, &sample, 4);
+                put_bytes(out, bits, 4);
+            }
+            break;
+    }
+}
+
+void WaveGener::render_channel(int channel, uint8_t* data, size_t total_frames){
+    ProfileTimer timer(ProfileStage::synthesis, total_frames*(bits_per_sample/8));
+    OscillatorBank bank(sample_rate, peak_amplitude());
+    std::vector<double> values(block_frames);
+    const channel_type& chords = channels[channel];
+    const size_t sample_bytes = bits_per_sample/8;
+    uint8_t* out = data + channel*sample_bytes;
+
+    // the chords are handed to the synthesizer just before they are needed, a short channel ends in silence
+    size_t next_chord = 0;
+    for (size_t written = 0; written<total_frames; ){
+        size_t count = min(block_frames, total_frames - written);
+        while (bank.pending() < count && next_chord < chords.size()) bank.push(chords[next_chord++]);
+        size_t rendered = min(count, bank.pending());
+        bank.render(values.data(), rendered);
+        std::fill(values.begin() + rendered, values.begin() + count, 0.0);
+
+        encode(values.data(), count, out, block_align);
+        out += count*block_align;
+        written += count;
+    }
+}
+
+void WaveGener::recreate_pcm(ofstream& wav, size_t frames){
+    ProfileTimer timer(ProfileStage::audio_output, frames*block_align);
+    const size_t sample_bytes = bits_per_sample/8;
+    while (frames > 0){
+        size_t count = std::min(frames, block_frames);
+        bytes.resize(count*block_align);
+        {
+            ProfileTimer synthesis(ProfileStage::synthesis, count*block_align);
+            for (int j = 0; j<num_channels; j++){
+                size_t rendered = std::min(count, banks[j].pending());
+                banks[j].render(block[j].data(), rendered);
+                std::fill(block[j].begin() + rendered, block[j].begin() + count, 0.0);
+                // writing the data for each channel in an interleaved fashion (respecting the .wav file format)
+                encode(block[j].data(), count, bytes.data() + j*sample_bytes, block_align);
             }
         }
-        channels_values.push_back(values);
+        wav.write(reinterpret_cast<const char*>(bytes.data()), static_cast<std::streamsize>(bytes.size()));
+        frames -= count;
     }
+}
+
+void WaveGener::header_bytes(uint8_t* out, uint32_t data_size) const{
+    out = put_tag(out, chunk_id);
+    out = put_bytes(out, 36 + data_size, 4);
+    out = put_tag(out, format);
+
+    out = put_tag(out, subchunk1_id);
+    out = put_bytes(out, subchunk1_size, 4);
+    out = put_bytes(out, audio_format, 2);
+    out = put_bytes(out, num_channels, 2);
+    out = put_bytes(out, sample_rate, 4);
+    out = put_bytes(out, byte_rate, 4);
+    out = put_bytes(out, block_align, 2);
+    out = put_bytes(out, bits_per_sample, 2);
+
+    out = put_tag(out, subchunk2_id);
+    put_bytes(out, data_size, 4);
+}
+
+// the sizes are not known yet, patch_sizes fills them in once the data is written
+void WaveGener::write_header(ofstream& wav){
+    uint8_t header[header_size];
+    header_bytes(header, 0);
+    wav.write(reinterpret_cast<const char*>(header), header_size);
+}
 
-    return channels_values;
+void WaveGener::patch_sizes(ofstream& wav, int start_audio){
+    int end_audio = (int)wav.tellp();
+    int diff = end_audio - start_audio;
+    wav.seekp(start_audio-4);
+    write_as_bytes(wav, end_audio - start_audio, 4);
+    wav.seekp(4, ios::beg);
+    write_as_bytes(wav, 36 + diff, 4);
 }
 
 void WaveGener::write_to_file(const string& filePath){
-    ofstream wav;
-    wav.open(filePath, ios::binary);
-    if (wav.is_open()){
-        wav << chunk_id;
-        wav << chunk_size;
-        wav << format;
-
-        wav << subchunk1_id;
-        write_as_bytes(wav, subchunk1_size, 4);
-        write_as_bytes(wav, audio_format,2 );
-        write_as_bytes(wav, num_channels, 2);
-        write_as_bytes(wav, sample_rate, 4);
-        write_as_bytes(wav, byte_rate, 4);
-        write_as_bytes(wav, block_align, 2);
-        write_as_bytes(wav, bits_per_sample, 2);
-
-        wav << subchunk2_id;
-        wav << subchunk2_size;
-
-
-        // reconstructing the pcm wave form based on the generated representation
-        // introducing fade-in and fade-out around the segment connections to increase fluency in the transitions
-        int start_audio = (int)wav.tellp();
-
-        std::vector<std::vector<double>> channels_values = recreate_pcm();
-
-        // writing the data for each channel in an interleaved fashion (respecting the .wav file format)
-        for (int i = 0; i<channels_values[0].size(); i++){
-            for (int j = 0; j<channels_values.size(); j++){
-                write_as_bytes(wav, channels_values[j][i], bits_per_sample/8);
-            }
+    // channels that are shorter than the longest one are padded with silence
+    size_t total_frames = 0;
+    for (auto&& chords : channels){
+        size_t frames = 0;
+        for (auto&& chord : chords) frames += OscillatorBank::chord_length(chord.duration, sample_rate);
+        total_frames = max(total_frames, frames);
+    }
+    size_t data_size = total_frames*block_align;
+    if (data_size > numeric_limits<uint32_t>::max() - 36) throw std::runtime_error("The output audio does not fit into a .wav file");
+
+    ProfileTimer timer(ProfileStage::audio_output, header_size + data_size);
+    MappedOutputFile wav(filePath, header_size + data_size);
+    if (!wav.is_open()) throw std::runtime_error("The output audio file cannot be opened");
+    header_bytes(wav.data(), static_cast<uint32_t>(data_size));
+
+    // reconstructing the pcm wave form based on the generated representation
+    // every channel owns its interleaved slots, so the channels are rendered independently of each other
+    uint8_t* data = wav.data() + header_size;
+    unsigned workers = min<unsigned>(max(1u, options.threads), max(1, num_channels));
+    std::vector<std::thread> threads;
+    std::exception_ptr error;
+    std::mutex error_mutex;
+    auto work = [&](unsigned worker){
+        try {
+            for (int j = worker; j<num_channels; j += workers) render_channel(j, data, total_frames);
+        }catch(...){
+            std::lock_guard<std::mutex> lock(error_mutex);
+            if (!error) error = std::current_exception();
         }
+    };
+    for (unsigned worker = 1; worker<workers; worker++) threads.emplace_back(work, worker);
+    work(0);
+    for (std::thread& thread : threads) thread.join();
+    if (error) std::rethrow_exception(error);
 
+    if (!wav.close()) throw std::runtime_error("The output audio file cannot be written");
+}
 
-        int end_audio = (int)wav.tellp();
-        int diff = end_audio - start_audio;
-        wav.seekp(start_audio-4);
-        write_as_bytes(wav, end_audio - start_audio, 4);
-        wav.seekp(4, ios::beg);
-        write_as_bytes(wav, 36 + diff, 4);
+void WaveGener::begin_stream(const string& filePath){
+    stream.open(filePath, ios::binary);
+    if (!stream.is_open()) throw std::runtime_error("The output audio file cannot be opened");
+    write_header(stream);
+    stream_start = (int)stream.tellp();
+    reset_banks();
+}
 
+void WaveGener::append_row(const std::vector<segment_chord>& row){
+    if (!stream.is_open()) return;
+    for (int j = 0; j<num_channels; j++){
+        banks[j].push(row[j]);
     }
 
-    wav.close();
+    // only the frames every channel has queued already can be interleaved
+    size_t frames = banks[0].pending();
+    for (auto&& bank : banks) frames = min(frames, bank.pending());
+    recreate_pcm(stream, frames);
+}
+
+void WaveGener::end_stream(){
+    if (!stream.is_open()) return;
+
+    // channels that queued fewer samples are padded with silence
+    size_t frames = 0;
+    for (auto&& bank : banks) frames = max(frames, bank.pending());
+    recreate_pcm(stream, frames);
 
+    patch_sizes(stream, stream_start);
+    stream.close();
 }
 
 #endif //PROJECT_WAV_CREATION_H
@@ -10,6 +10,227 @@
 #include <utility>
 #include <vector>
 #include <string>
+#include <span>
+#include <cstring>
+#include <cstdint>
+#include <algorithm>
+#include <stdexcept>
+#include <type_traits>
+#include <variant>
+#include "mapped_file.h"
+#include "profiler.h"
+#include "simd_kernels.h"
+
+// little endian readers for the header fields
+template<typename T>
+T read_le(const uint8_t* p){
+    T value;
+    std::memcpy(&value, p, sizeof(T)); // assuming a little endian host
+    return value;
+}
+
+// contents of the "fmt " chunk, shared by the in-memory (WaveFile) and the streaming (WaveStream) reader
+struct WaveFormat {
+    short audio_format = 0;
+    short num_channels = 0;
+    int sample_rate = 0;
+    int byte_rate = 0;
+    short block_align = 0;
+    short bits_per_sample = 0;
+
+    bool parse(const uint8_t* body, size_t size);
+    bool supported() const;
+    size_t frame_bytes() const {return static_cast<size_t>(num_channels)*(bits_per_sample/8);}
+};
+
+bool WaveFormat::parse(const uint8_t* body, size_t size){
+    if (size < 16) return false;
+    audio_format = read_le<int16_t>(body);
+    num_channels = read_le<int16_t>(body + 2);
+    sample_rate = read_le<int32_t>(body + 4);
+    byte_rate = read_le<int32_t>(body + 8);
+    block_align = read_le<int16_t>(body + 12);
+    bits_per_sample = read_le<int16_t>(body + 14);
+    if (static_cast<uint16_t>(audio_format) == 0xFFFE && size >= 26){
+        audio_format = read_le<int16_t>(body + 24); // WAVE_FORMAT_EXTENSIBLE - the sub-format GUID starts with the format tag
+    }
+    return true;
+}
+
+bool WaveFormat::supported() const{
+    return num_channels > 0 && sample_rate > 0 &&
+            ((audio_format == 1 && (bits_per_sample == 8 || bits_per_sample == 16 || bits_per_sample == 24 || bits_per_sample == 32)) ||
+             (audio_format == 3 && (bits_per_sample == 32 || bits_per_sample == 64)));
+}
+
+// the sample encodings of the data chunk, each decoding one little-endian sample to the int scale of the analysis
+// integer formats keep their native scale, IEEE float samples are scaled to the 24-bit range
+struct PcmU8 { // 8-bit pcm is unsigned
+    static constexpr size_t bytes = 1;
+    static int decode(const uint8_t* p){return static_cast<int>(p[0]) - 128;}
+};
+struct PcmS16 {
+    static constexpr size_t bytes = 2;
+    static int decode(const uint8_t* p){return static_cast<int>(read_le<int16_t>(p));}
+};
+struct PcmS24 { // sign extension through the top byte of a 32-bit value
+    static constexpr size_t bytes = 3;
+    static int decode(const uint8_t* p){
+        return static_cast<int>(static_cast<uint32_t>(p[0]) << 8 | static_cast<uint32_t>(p[1]) << 16 | static_cast<uint32_t>(p[2]) << 24) >> 8;
+    }
+};
+struct PcmS32 {
+    static constexpr size_t bytes = 4;
+    static int decode(const uint8_t* p){return read_le<int32_t>(p);}
+};
+struct PcmF32 {
+    static constexpr size_t bytes = 4;
+    static int decode(const uint8_t* p){return static_cast<int>(std::clamp(static_cast<double>(read_le<float>(p)), -1.0, 1.0)*8388607.0);}
+};
+struct PcmF64 {
+    static constexpr size_t bytes = 8;
+    static int decode(const uint8_t* p){return static_cast<int>(std::clamp(read_le<double>(p), -1.0, 1.0)*8388607.0);}
+};
+
+// decodes num_frames interleaved frames into planar samples of type Out, channel c starts at planar + c*channel_stride
+template<typename Out>
+using DecodeKernelOf = void (*)(const uint8_t* data, size_t num_frames, int num_channels, Out* planar, size_t channel_stride);
+using DecodeKernel = DecodeKernelOf<int>;
+
+// one kernel per encoding, channel count (Channels 0 takes the count at run time) and stored type - the loops have
+// constant strides and no branches, mono and stereo read every frame once and in order
+template<typename Sample, int Channels, typename Out>
+void decodeKernel(const uint8_t* data, size_t num_frames, int num_channels, Out* planar, size_t channel_stride){
+    constexpr size_t size = Sample::bytes;
+    if constexpr (Channels == 1){
+        for (size_t i = 0; i<num_frames; i++) planar[i] = static_cast<Out>(Sample::decode(data + i*size));
+    }else if constexpr (Channels == 2){
+        Out* left = planar;
+        Out* right = planar + channel_stride;
+        for (size_t i = 0; i<num_frames; i++){
+            left[i] = static_cast<Out>(Sample::decode(data + 2*i*size));
+            right[i] = static_cast<Out>(Sample::decode(data + (2*i + 1)*size));
+        }
+    }else{
+        const size_t frame_size = num_channels*size;
+        for (int c = 0; c<num_channels; c++){
+            const uint8_t* src = data + c*size;
+            Out* dst = planar + c*channel_stride;
+            for (size_t i = 0; i<num_frames; i++) dst[i] = static_cast<Out>(Sample::decode(src + i*frame_size));
+        }
+    }
+}
+
+#ifdef AUDIO_TRANSCRIBER_X86_SIMD
+// the byte-wise sign extension of 24-bit samples does not vectorize on its own, the mono and stereo kernels get an AVX2
+// version (the other formats are vectorized by the compiler); the samples are widened to 32-bit lanes and stored as Out
+TARGET_AVX2 inline void avx2StoreSamples(int* out, __m128i v){_mm_storeu_si128(reinterpret_cast<__m128i*>(out), v);}
+TARGET_AVX2 inline void avx2StoreSamples(float* out, __m128i v){_mm_storeu_ps(out, _mm_cvtepi32_ps(v));}
+TARGET_AVX2 inline void avx2StoreSamples(int16_t* out, __m128i v){_mm_storel_epi64(reinterpret_cast<__m128i*>(out), _mm_packs_epi32(v, v));}
+TARGET_AVX2 inline void avx2StoreSamples(int* out, __m256i v){_mm256_storeu_si256(reinterpret_cast<__m256i*>(out), v);}
+TARGET_AVX2 inline void avx2StoreSamples(float* out, __m256i v){_mm256_storeu_ps(out, _mm256_cvtepi32_ps(v));}
+TARGET_AVX2 inline void avx2StoreSamples(int16_t* out, __m256i v){
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(out), _mm_packs_epi32(_mm256_castsi256_si128(v), _mm256_extracti128_si256(v, 1)));
+}
+
+// 8 consecutive 24-bit samples (24 bytes, 4 in each 128-bit half) moved to the top of 32-bit lanes and shifted down
+// with their sign, the second half is loaded 4 bytes past its samples - the loops stop early enough for that read
+TARGET_AVX2 inline __m256i avx2Widen24(const uint8_t* p){
+    const __m256i spread = _mm256_setr_epi8(-1, 0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11,
+                                            -1, 0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11);
+    __m256i x = _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p))),
+                                        _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + 12)), 1);
+    return _mm256_srai_epi32(_mm256_shuffle_epi8(x, spread), 8);
+}
+
+template<int Channels, typename Out>
+TARGET_AVX2 void avx2DecodeS24(const uint8_t* data, size_t num_frames, int num_channels, Out* planar, size_t channel_stride){
+    size_t i = 0;
+    if constexpr (Channels == 1){
+        for (; i+10<=num_frames; i+=8) avx2StoreSamples(planar + i, avx2Widen24(data + 3*i));
+    }else{
+        const __m256i split = _mm256_setr_epi32(0, 2, 4, 6, 1, 3, 5, 7); // left samples to the low half, right to the high
+        for (; i+5<=num_frames; i+=4){
+            __m256i x = _mm256_permutevar8x32_epi32(avx2Widen24(data + 6*i), split);
+            avx2StoreSamples(planar + i, _mm256_castsi256_si128(x));
+            avx2StoreSamples(planar + channel_stride + i, _mm256_extracti128_si256(x, 1));
+        }
+    }
+    decodeKernel<PcmS24, Channels, Out>(data + Channels*3*i, num_frames - i, num_channels, planar + i, channel_stride);
+}
+
+// the vector kernel for the cpu, nullptr when there is none for the format
+template<typename Sample, typename Out>
+DecodeKernelOf<Out> simdDecodeKernel(int num_channels){
+    static const SimdLevel level = detectSimdLevel();
+    if constexpr (std::is_same_v<Sample, PcmS24>){
+        if (level == SimdLevel::avx2 && num_channels <= 2) return num_channels == 1 ? avx2DecodeS24<1, Out> : avx2DecodeS24<2, Out>;
+    }
+    return nullptr;
+}
+#endif // AUDIO_TRANSCRIBER_X86_SIMD
+
+template<typename Sample, typename Out>
+DecodeKernelOf<Out> decodeKernelFor(int num_channels){
+#ifdef AUDIO_TRANSCRIBER_X86_SIMD
+    if (DecodeKernelOf<Out> kernel = simdDecodeKernel<Sample, Out>(num_channels)) return kernel;
+#endif
+    switch (num_channels){
+        case 1: return decodeKernel<Sample, 1, Out>;
+        case 2: return decodeKernel<Sample, 2, Out>;
+        default: return decodeKernel<Sample, 0, Out>;
+    }
+}
+
+// the kernel of a format, resolved once per file (nullptr when the format is not supported)
+template<typename Out = int>
+DecodeKernelOf<Out> selectDecodeKernel(const WaveFormat& fmt){
+    if (!fmt.supported()) return nullptr;
+    if (fmt.audio_format == 3){
+        return fmt.bits_per_sample == 32 ? decodeKernelFor<PcmF32, Out>(fmt.num_channels) : decodeKernelFor<PcmF64, Out>(fmt.num_channels);
+    }
+    switch (fmt.bits_per_sample){
+        case 8: return decodeKernelFor<PcmU8, Out>(fmt.num_channels);
+        case 16: return decodeKernelFor<PcmS16, Out>(fmt.num_channels);
+        case 24: return decodeKernelFor<PcmS24, Out>(fmt.num_channels);
+        default: return decodeKernelFor<PcmS32, Out>(fmt.num_channels);
+    }
+}
+
+// type the decoded samples are kept in: the narrowest one holding the format (int16_t up to 16-bit pcm, int otherwise)
+// or float for every format (the same values, exact up to 24 bits)
+enum class SampleStorage {native, float32};
+
+// the decoded samples of all channels in a single buffer, channel after channel
+class PlanarSamples {
+public:
+    size_t num_frames = 0;
+    int num_channels = 0;
+
+    // calls f with the channels as std::vector<std::span<const S>>, S being the stored type (int16_t, int or float)
+    template<typename F>
+    decltype(auto) visit(F&& f) const;
+    int at(int channel, size_t frame) const; // a single sample converted to int
+    size_t size_bytes() const {return std::visit([](const auto& data){return data.size()*sizeof(data[0]);}, data_);}
+
+private:
+    friend class WaveFile;
+    std::variant<std::vector<int16_t>, std::vector<int>, std::vector<float>> data_;
+};
+
+template<typename F>
+decltype(auto) PlanarSamples::visit(F&& f) const{
+    return std::visit([&](const auto& data){
+        using S = typename std::decay_t<decltype(data)>::value_type;
+        std::vector<std::span<const S>> channels;
+        for (int c = 0; c<num_channels; c++) channels.emplace_back(data.data() + c*num_frames, num_frames);
+        return f(channels);
+    }, data_);
+}
+
+int PlanarSamples::at(int channel, size_t frame) const{
+    return std::visit([&](const auto& data){return static_cast<int>(data[channel*num_frames + frame]);}, data_);
+}
 
 class WaveFile{
 public:
@@ -32,74 +253,175 @@ public:
     std::string subchunk2_id;
     int subchunk_size;
 
-    // data
-    std::vector<std::vector<int>> channels;
+    // data - integer formats keep their native scale, IEEE float samples are scaled to the 24-bit range
+    PlanarSamples samples;
 
-    explicit WaveFile(const std::string& filename);
+    explicit WaveFile(const std::string& filename, SampleStorage storage = SampleStorage::native);
+    WaveFile(const WaveFile&) = delete;
+    WaveFile& operator=(const WaveFile&) = delete;
+    WaveFile(WaveFile&&) = default;
 
 private:
     std::string m_filename;
-    void process_wav(const std::string&);
+    void process_wav(const std::string&, SampleStorage storage);
 
 };
 
-WaveFile::WaveFile(const std::string& filename){
+WaveFile::WaveFile(const std::string& filename, SampleStorage storage){
     chunk_id.resize(4);
     format.resize(4);
     subchunk1_id.resize(4);
     subchunk2_id.resize(4);
-    process_wav(filename);
+    process_wav(filename, storage);
 }
 
-
-void WaveFile::process_wav(const std::string& filename){
-    std::fstream file;
-    file.open(filename, std::ios::in | std::ios::binary);
+void WaveFile::process_wav(const std::string& filename, SampleStorage storage){
+    ProfileTimer timer(ProfileStage::decode);
+    m_filename = filename;
+    MappedFile file(filename);
 
     if (!file.is_open()){
-        std::cerr << "The file cannot be opened\n";
-        std::exit(1);
+        throw std::runtime_error("The file cannot be opened");
     }
 
-    //file.read(reinterpret_cast<char*>(&chunk_id), 4);
-    file.read(reinterpret_cast<char*>(&chunk_id[0]),4);
-    file.read(reinterpret_cast<char*>(&chunk_size), 4);
-    file.read(reinterpret_cast<char*>(&format[0]), 4);
-
-    file.read(reinterpret_cast<char*>(&subchunk1_id[0]), 4);
-    file.read(reinterpret_cast<char*>(&subchunk1_size), 4);
-    file.read(reinterpret_cast<char*>(&audio_format),2);
-    file.read(reinterpret_cast<char*>(&num_channels), 2);
-    file.read(reinterpret_cast<char*>(&sample_rate), 4);
-    file.read(reinterpret_cast<char*>(&byte_rate), 4);
-    file.read(reinterpret_cast<char*>(&block_align), 2);
-    file.read(reinterpret_cast<char*>(&bits_per_sample), 2);
-
-    file.read(reinterpret_cast<char*>(&subchunk2_id[0]), 4);
-    file.read(reinterpret_cast<char*>(&subchunk_size), 4);
-
-    // resize the channels vector for the number of channels
-    channels.resize(num_channels, std::vector<int>());
-
-    //reading the data into respective channels
-    if (subchunk_size != chunk_size - 20 - subchunk1_size){
-        subchunk_size = chunk_size - 20 - subchunk1_size;
+    const uint8_t* bytes = file.data();
+    size_t size = file.size();
+    if (size < 12 || std::memcmp(bytes, "RIFF", 4) != 0 || std::memcmp(bytes + 8, "WAVE", 4) != 0){
+        throw std::runtime_error("The file is not a RIFF/WAVE file");
     }
+    std::memcpy(&chunk_id[0], bytes, 4);
+    chunk_size = read_le<int32_t>(bytes + 4);
+    std::memcpy(&format[0], bytes + 8, 4);
 
-    for (int byte = 0; byte<subchunk_size/num_channels/(bits_per_sample/8); ++byte){
-        for (int i = 0; i<num_channels; ++i){
-            char tmp;
-            int value = 0;
-            for (int j = 0; j<bits_per_sample/8; ++j){
-                file.read(reinterpret_cast<char*>(&tmp), 1);
-                value |= (static_cast<uint8_t>(tmp) << (8*j)); // assuming little endian representation
-            }
-            channels[i].push_back(value);
+    // walking the chunks - anything besides "fmt " and "data" (LIST, fact, ...) is skipped
+    const uint8_t* data = nullptr;
+    size_t data_size = 0;
+    bool has_fmt = false;
+    WaveFormat fmt;
+    size_t offset = 12;
+    while (offset + 8 <= size){
+        const uint8_t* chunk = bytes + offset;
+        size_t body_size = read_le<uint32_t>(chunk + 4);
+        size_t available = size - offset - 8;
+
+        if (std::memcmp(chunk, "fmt ", 4) == 0 && body_size <= available && fmt.parse(chunk + 8, body_size)){
+            std::memcpy(&subchunk1_id[0], chunk, 4);
+            subchunk1_size = static_cast<int>(body_size);
+            has_fmt = true;
+        }else if (std::memcmp(chunk, "data", 4) == 0){
+            std::memcpy(&subchunk2_id[0], chunk, 4);
+            data = chunk + 8;
+            data_size = std::min(body_size, available); // streamed recordings may leave the size unset
+            break;
         }
+        offset += 8 + body_size + (body_size & 1); // chunks are padded to an even size
+    }
+
+    if (!has_fmt || !data || !fmt.supported()){
+        throw std::runtime_error("Unsupported or malformed .wav file (only 8/16/24/32-bit PCM and 32/64-bit float are supported)");
     }
+    audio_format = fmt.audio_format;
+    num_channels = fmt.num_channels;
+    sample_rate = fmt.sample_rate;
+    byte_rate = fmt.byte_rate;
+    block_align = fmt.block_align;
+    bits_per_sample = fmt.bits_per_sample;
+
+    const size_t frame_size = fmt.frame_bytes();
+    size_t num_frames = data_size/frame_size;
+    subchunk_size = static_cast<int>(num_frames*frame_size);
+
+    if (storage == SampleStorage::float32) samples.data_.emplace<std::vector<float>>();
+    else if (fmt.audio_format == 1 && fmt.bits_per_sample <= 16) samples.data_.emplace<std::vector<int16_t>>();
+    else samples.data_.emplace<std::vector<int>>();
+    samples.num_frames = num_frames;
+    samples.num_channels = num_channels;
+    // decoded block by block, the pages of every decoded block are dropped so that the file and the samples are not
+    // resident at the same time
+    std::visit([&](auto& buffer){
+        using S = typename std::decay_t<decltype(buffer)>::value_type;
+        buffer.resize(num_frames*num_channels);
+        const DecodeKernelOf<S> kernel = selectDecodeKernel<S>(fmt);
+        constexpr size_t block = 1 << 16;
+        for (size_t first = 0; first<num_frames; first += block){
+            const size_t count = std::min(block, num_frames - first);
+            kernel(data + first*frame_size, count, num_channels, buffer.data() + first, num_frames);
+            file.discard(static_cast<size_t>(data - bytes) + first*frame_size, count*frame_size);
+        }
+    }, samples.data_);
+    timer.add_bytes(subchunk_size);
+}
+
+// reads the samples of a .wav file block by block, only one block of the file is held in memory at a time
+class WaveStream{
+public:
+    WaveFormat format;
+    size_t num_frames = 0; // total number of frames in the data chunk
+
+    explicit WaveStream(const std::string& filename);
+    // decoding up to max_frames following frames into planar, channel c starts at planar + c*max_frames
+    // returns the number of decoded frames, 0 once the data chunk is exhausted
+    size_t read(size_t max_frames, int* planar);
+
+private:
+    std::ifstream file_;
+    DecodeKernel decode_ = nullptr;
+    size_t frames_left_ = 0;
+    std::vector<uint8_t> bytes_;
+};
+
+WaveStream::WaveStream(const std::string& filename) : file_(filename, std::ios::in | std::ios::binary){
+    if (!file_.is_open()){
+        throw std::runtime_error("The file cannot be opened");
+    }
+
+    uint8_t header[12];
+    file_.read(reinterpret_cast<char*>(header), 12);
+    if (!file_ || std::memcmp(header, "RIFF", 4) != 0 || std::memcmp(header + 8, "WAVE", 4) != 0){
+        throw std::runtime_error("The file is not a RIFF/WAVE file");
+    }
+
+    file_.seekg(0, std::ios::end);
+    size_t file_size = static_cast<size_t>(file_.tellg());
+    size_t offset = 12;
+    bool has_fmt = false;
+    while (offset + 8 <= file_size){
+        uint8_t chunk[8];
+        file_.seekg(static_cast<std::streamoff>(offset));
+        file_.read(reinterpret_cast<char*>(chunk), 8);
+        size_t body_size = read_le<uint32_t>(chunk + 4);
+        size_t available = file_size - offset - 8;
+
+        if (std::memcmp(chunk, "fmt ", 4) == 0 && body_size <= available){
+            std::vector<uint8_t> body(body_size);
+            file_.read(reinterpret_cast<char*>(body.data()), static_cast<std::streamsize>(body_size));
+            has_fmt = format.parse(body.data(), body_size);
+        }else if (std::memcmp(chunk, "data", 4) == 0){
+            if (!has_fmt || !format.supported()) break;
+            num_frames = std::min(body_size, available)/format.frame_bytes(); // streamed recordings may leave the size unset
+            frames_left_ = num_frames;
+            decode_ = selectDecodeKernel(format);
+            return; // the stream is left positioned at the first sample
+        }
+        offset += 8 + body_size + (body_size & 1); // chunks are padded to an even size
+    }
+
+    throw std::runtime_error("Unsupported or malformed .wav file (only 8/16/24/32-bit PCM and 32/64-bit float are supported)");
+}
+
+size_t WaveStream::read(size_t max_frames, int* planar){
+    size_t frames = std::min(max_frames, frames_left_);
+    if (frames == 0) return 0;
+    ProfileTimer timer(ProfileStage::decode);
 
+    bytes_.resize(frames*format.frame_bytes());
+    file_.read(reinterpret_cast<char*>(bytes_.data()), static_cast<std::streamsize>(bytes_.size()));
+    frames = static_cast<size_t>(file_.gcount())/format.frame_bytes();
+    frames_left_ = frames == 0 ? 0 : frames_left_ - frames;
 
-    file.close();
+    decode_(bytes_.data(), frames, format.num_channels, planar, max_frames);
+    timer.add_bytes(frames*format.frame_bytes());
+    return frames;
 }
 
 
@@ -0,0 +1,46 @@
+//
+// Created by Samuel Longauer on 17/10/2026.
+//
+
+// replacement of the global allocation functions that feeds AllocationCounter
+// a translation unit of its own, linked only into the programs that count allocations - the application keeps the
+// allocator of the standard library unless it is built with AUDIO_TRANSCRIBER_COUNT_ALLOCATIONS
+
+#include <cstdlib>
+#include <new>
+#include "allocation_counter.h"
+
+void* operator new(std::size_t size){
+    if (AllocationCounter::enabled()) AllocationCounter::record();
+    if (void* pointer = std::malloc(size ? size : 1)) return pointer;
+    throw std::bad_alloc();
+}
+
+void* operator new[](std::size_t size){
+    return ::operator new(size);
+}
+
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept{
+    if (AllocationCounter::enabled()) AllocationCounter::record();
+    return std::malloc(size ? size : 1);
+}
+
+void* operator new[](std::size_t size, const std::nothrow_t&) noexcept{
+    return ::operator new(size, std::nothrow);
+}
+
+void operator delete(void* pointer) noexcept{
+    std::free(pointer);
+}
+
+void operator delete[](void* pointer) noexcept{
+    std::free(pointer);
+}
+
+void operator delete(void* pointer, std::size_t) noexcept{
+    std::free(pointer);
+}
+
+void operator delete[](void* pointer, std::size_t) noexcept{
+    std::free(pointer);
+}
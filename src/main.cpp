@@ -2,9 +2,18 @@
 #include <vector>
 #include <string>
 #include <exception>
+#include <memory>
+#include <thread>
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
 #include "audio_analysis.h"
 #include "audio_generation.h"
 #include "transcript_generation.h"
+#include "result_cache.h"
+#include "allocation_counter.h"
 
 
 struct Args{
@@ -13,10 +22,27 @@ struct Args{
     std::string transcript_file_path;
     int num_frequencies;
     double segment_size;
+    bool streaming;
+    bool live = false; // raw PCM is read from the standard input instead of a file
+    bool live_wait = false; // the reader waits for the analysis instead of dropping input
+    WaveFormat live_format; // layout of the raw PCM of the live mode
+    std::string batch_path; // directory of .wav files or a manifest of input/output triples
+    std::string output_dir; // destination of the outputs of a directory batch
+    std::string profile_path; // per-stage timings are collected and written here when set
+    std::string cache_dir; // analysis results are reused from (and stored into) this directory when set
+    uint64_t cache_size_mb = 256;
+    AnalysisOptions analysis_options;
+    AudioOutputOptions audio_options;
+    TranscriptOptions transcript_options;
 
     Args(){
         num_frequencies = 1; // only the most dominant frequency will be extracted from each sample
         segment_size = 0; // the recording is going to be analyzed as a whole
+        streaming = false; // the whole recording is loaded before the analysis
+        live_format.audio_format = 1; // 16-bit mono at 44.1 kHz unless specified
+        live_format.num_channels = 1;
+        live_format.sample_rate = 44100;
+        live_format.bits_per_sample = 16;
     }
 };
 
@@ -28,6 +54,32 @@ Args parse_args(int argc, char *argv[]){
     std::string input_audio_flag = "--input_audio";
     std::string output_audio_flag = "--output_audio";
     std::string transcript_flag = "--transcript";
+    std::string fast_fft_size_flag = "--fast_fft_size";
+    std::string matched_fft_size_flag = "--matched_fft_size";
+    std::string precision_flag = "--precision";
+    std::string streaming_flag = "--streaming";
+    std::string hop_size_flag = "--hop_size";
+    std::string threads_flag = "--threads";
+    std::string batch_flag = "--batch";
+    std::string engine_flag = "--engine";
+    std::string segmentation_flag = "--segmentation";
+    std::string cqt_bins_flag = "--cqt_bins_per_octave";
+    std::string output_dir_flag = "--output_dir";
+    std::string output_format_flag = "--output_format";
+    std::string transcript_format_flag = "--transcript_format";
+    std::string merge_repeats_flag = "--merge_repeats";
+    std::string profile_flag = "--profile";
+    std::string cache_dir_flag = "--cache_dir";
+    std::string cache_size_flag = "--cache_size_mb";
+    std::string channels_flag = "--channels";
+    std::string channel_correlation_flag = "--channel_correlation";
+    std::string target_rate_flag = "--target_rate";
+    std::string sample_storage_flag = "--sample_storage";
+    std::string live_flag = "--live";
+    std::string live_wait_flag = "--live_wait";
+    std::string sample_rate_flag = "--sample_rate";
+    std::string input_channels_flag = "--input_channels";
+    std::string input_format_flag = "--input_format";
 
     Args parsed_args;
 
@@ -50,9 +102,135 @@ Args parse_args(int argc, char *argv[]){
             if (args[i] == transcript_flag){
                 parsed_args.transcript_file_path = args[i+1];
             }
+            if (args[i] == fast_fft_size_flag){
+                parsed_args.analysis_options.fast_fft_size = true;
+            }
+            if (args[i] == matched_fft_size_flag){
+                parsed_args.analysis_options.matched_fft_size = true;
+            }
+            if (args[i] == precision_flag){
+                if (args[i+1] == "float") parsed_args.analysis_options.precision = Precision::single_precision;
+                else if (args[i+1] == "double") parsed_args.analysis_options.precision = Precision::double_precision;
+                else throw std::exception();
+            }
+            if (args[i] == streaming_flag){
+                parsed_args.streaming = true;
+            }
+            if (args[i] == hop_size_flag){
+                parsed_args.analysis_options.hop_size = std::stod(args[i+1]);
+            }
+            if (args[i] == engine_flag){
+                if (args[i+1] == "cqt") parsed_args.analysis_options.engine = Engine::cqt;
+                else if (args[i+1] == "fft") parsed_args.analysis_options.engine = Engine::fft;
+                else throw std::exception();
+            }
+            if (args[i] == segmentation_flag){
+                if (args[i+1] == "onsets") parsed_args.analysis_options.segmentation = Segmentation::onsets;
+                else if (args[i+1] == "fixed") parsed_args.analysis_options.segmentation = Segmentation::fixed;
+                else throw std::exception();
+            }
+            if (args[i] == cqt_bins_flag){
+                int bins = std::stoi(args[i+1]);
+                if (bins != 12 && bins != 24) throw std::exception();
+                parsed_args.analysis_options.cqt_bins_per_octave = bins;
+            }
+            if (args[i] == output_format_flag){
+                if (args[i+1] == "pcm16") parsed_args.audio_options.format = SampleFormat::pcm16;
+                else if (args[i+1] == "pcm24") parsed_args.audio_options.format = SampleFormat::pcm24;
+                else if (args[i+1] == "float") parsed_args.audio_options.format = SampleFormat::float32;
+                else throw std::exception();
+            }
+            if (args[i] == transcript_format_flag){
+                if (args[i+1] == "text") parsed_args.transcript_options.format = TranscriptFormat::text;
+                else if (args[i+1] == "csv") parsed_args.transcript_options.format = TranscriptFormat::csv;
+                else if (args[i+1] == "binary") parsed_args.transcript_options.format = TranscriptFormat::binary;
+                else throw std::exception();
+            }
+            if (args[i] == merge_repeats_flag){
+                parsed_args.transcript_options.merge_repeats = true;
+            }
+            if (args[i] == profile_flag){
+                parsed_args.profile_path = args[i+1];
+            }
+            if (args[i] == cache_dir_flag){
+                parsed_args.cache_dir = args[i+1];
+            }
+            if (args[i] == cache_size_flag){
+                long size = std::stol(args[i+1]);
+                if (size < 0) throw std::exception();
+                parsed_args.cache_size_mb = size;
+            }
+            if (args[i] == channels_flag){
+                if (args[i+1] == "each") parsed_args.analysis_options.channel_mode = ChannelMode::each;
+                else if (args[i+1] == "mono-mix") parsed_args.analysis_options.channel_mode = ChannelMode::mono_mix;
+                else if (args[i+1] == "mid-side") parsed_args.analysis_options.channel_mode = ChannelMode::mid_side;
+                else throw std::exception();
+            }
+            if (args[i] == channel_correlation_flag){
+                parsed_args.analysis_options.duplicate_threshold = std::stod(args[i+1]);
+            }
+            if (args[i] == target_rate_flag){
+                int rate = std::stoi(args[i+1]);
+                if (rate < 0) throw std::exception();
+                parsed_args.analysis_options.target_rate = rate;
+            }
+            if (args[i] == sample_storage_flag){
+                if (args[i+1] == "native") parsed_args.analysis_options.sample_storage = SampleStorage::native;
+                else if (args[i+1] == "float") parsed_args.analysis_options.sample_storage = SampleStorage::float32;
+                else throw std::exception();
+            }
+            if (args[i] == live_flag){
+                parsed_args.live = true;
+            }
+            if (args[i] == live_wait_flag){
+                parsed_args.live_wait = true;
+            }
+            if (args[i] == sample_rate_flag){
+                parsed_args.live_format.sample_rate = std::stoi(args[i+1]);
+            }
+            if (args[i] == input_channels_flag){
+                parsed_args.live_format.num_channels = static_cast<short>(std::stoi(args[i+1]));
+            }
+            if (args[i] == input_format_flag){
+                if (args[i+1] == "s16") parsed_args.live_format.bits_per_sample = 16;
+                else if (args[i+1] == "s24") parsed_args.live_format.bits_per_sample = 24;
+                else if (args[i+1] == "s32") parsed_args.live_format.bits_per_sample = 32;
+                else if (args[i+1] == "f32") parsed_args.live_format.bits_per_sample = 32;
+                else throw std::exception();
+                parsed_args.live_format.audio_format = args[i+1] == "f32" ? 3 : 1;
+            }
+            if (args[i] == batch_flag){
+                parsed_args.batch_path = args[i+1];
+            }
+            if (args[i] == output_dir_flag){
+                parsed_args.output_dir = args[i+1];
+            }
+            if (args[i] == threads_flag){
+                int threads = std::stoi(args[i+1]);
+                if (threads < 0) throw std::exception();
+                // 0 uses every hardware thread
+                parsed_args.analysis_options.threads = threads > 0 ? threads : std::max(1u, std::thread::hardware_concurrency());
+            }
+        }
+        parsed_args.audio_options.threads = parsed_args.analysis_options.threads;
+        // it is mandatory to set exactly one of input_audio, the batch to process or the live input
+        if (!parsed_args.input_audio_file_path.empty() + !parsed_args.batch_path.empty() + parsed_args.live != 1){
+            throw std::exception();
+        }
+        // the live input is analyzed by its own sliding transform, block by block
+        if (parsed_args.live && (!parsed_args.live_format.supported() || parsed_args.streaming || parsed_args.analysis_options.hop_size > 0 ||
+            parsed_args.analysis_options.segmentation == Segmentation::onsets || !parsed_args.cache_dir.empty() ||
+            parsed_args.analysis_options.target_rate > 0)){
+            throw std::exception();
+        }
+        // overlapping frames need a fixed frame length and are only supported on the whole loaded recording
+        if (parsed_args.analysis_options.hop_size < 0 ||
+            (parsed_args.analysis_options.hop_size > 0 && (parsed_args.segment_size <= 0 || parsed_args.streaming))){
+            throw std::exception();
         }
-        // it is mandatory to set input_audio
-        if (parsed_args.input_audio_file_path.empty()){
+        // the note events are detected on the whole loaded recording, they replace both the fixed segments and the frames
+        if (parsed_args.analysis_options.segmentation == Segmentation::onsets &&
+            (parsed_args.streaming || parsed_args.analysis_options.hop_size > 0)){
             throw std::exception();
         }
     }catch(...){
@@ -63,21 +241,203 @@ Args parse_args(int argc, char *argv[]){
     return parsed_args;
 }
 
-int main(int argc, char *argv[]) {
+// analysis and output generation run block by block, each row of results is written as soon as it is available
+void transcribeStreaming(const AudioAnalyzer& analyzer, const std::string& input, const std::string& output_audio, const std::string& transcript_path, const AudioOutputOptions& audio_options, const TranscriptOptions& transcript_options){
+    std::unique_ptr<TranscriptWriter> transcript;
+    std::unique_ptr<WaveGener> audio;
+
+    analyzer.analyzeStream(input, [&](const std::vector<segment_chord>& row){
+        if (!transcript_path.empty() && !transcript){
+            transcript = std::make_unique<TranscriptWriter>(transcript_path, (int)row.size(), transcript_options);
+        }
+        if (!output_audio.empty() && !audio){
+            audio = std::make_unique<WaveGener>(std::vector<channel_type>(row.size()), audio_options);
+            audio->begin_stream(output_audio);
+        }
+        if (transcript) transcript->write_row(row);
+        if (audio) audio->append_row(row);
+    });
 
-    auto [ inputAudioFilePath, outputAudioFilePath, transcriptFilePath, num_frequencies, segment_size ] = parse_args(argc, argv);
-    AudioAnalyzer analyzer(segment_size, num_frequencies);
-    channel_field data = analyzer.analyzeAudio(inputAudioFilePath);
+    if (audio) audio->end_stream();
+    if (transcript) transcript->close();
+}
+
+// empty output paths are skipped, failures are reported by std::runtime_error
+// the cache (when present) serves the whole-file analysis, the streaming analysis always runs
+void transcribeFile(const AudioAnalyzer& analyzer, const std::string& input, const std::string& output_audio, const std::string& transcript, bool streaming, const AudioOutputOptions& audio_options, const TranscriptOptions& transcript_options, const ResultCache* cache){
+    if (streaming){
+        transcribeStreaming(analyzer, input, output_audio, transcript, audio_options, transcript_options);
+        return;
+    }
+
+    channel_field data = cache ? cache->analyze(analyzer, input) : analyzer.analyzeAudio(input);
 
     // reconstructing the audio from extracted dominant frequencies
-    if (!outputAudioFilePath.empty()){
-        generateAudio(outputAudioFilePath, data);
+    if (!output_audio.empty()){
+        generateAudio(output_audio, data, audio_options);
     }
 
     // generating a transcript based on the input audio file
-    if (!transcriptFilePath.empty()){
-        generateTranscript(transcriptFilePath, data);
+    if (!transcript.empty()){
+        generateTranscript(transcript, data, transcript_options);
+    }
+}
+
+// raw PCM from the standard input, every row is written out as soon as it is analyzed, the counters go to the standard error
+void transcribeLive(const AudioAnalyzer& analyzer, const Args& args){
+    std::unique_ptr<TranscriptWriter> transcript;
+    std::unique_ptr<WaveGener> audio;
+
+    LiveStats stats = analyzer.analyzeLive(stdin, args.live_format, args.live_wait, [&](const std::vector<segment_chord>& row){
+        if (!args.transcript_file_path.empty() && !transcript){
+            transcript = std::make_unique<TranscriptWriter>(args.transcript_file_path, (int)row.size(), args.transcript_options);
+        }
+        if (!args.output_audio_file_path.empty() && !audio){
+            audio = std::make_unique<WaveGener>(std::vector<channel_type>(row.size()), args.audio_options);
+            audio->begin_stream(args.output_audio_file_path);
+        }
+        if (transcript){
+            transcript->write_row(row);
+            transcript->flush();
+        }
+        if (audio) audio->append_row(row);
+    });
+
+    if (audio) audio->end_stream();
+    if (transcript) transcript->close();
+    std::cerr << "live: " << stats.frames << " frames analyzed, " << stats.dropped_frames << " frames dropped, " << stats.rows
+              << " rows, latency mean " << stats.mean_latency*1e3 << " ms, max " << stats.max_latency*1e3 << " ms\n";
+}
+
+struct BatchJob{
+    std::string input_audio_file_path;
+    std::string output_audio_file_path;
+    std::string transcript_file_path;
+    std::uintmax_t input_size = 0;
+    std::string error; // empty when the job succeeded
+};
+
+// a directory yields one job per .wav file with both outputs named after the input inside output_dir
+// a manifest lists one job per line: "input output_audio transcript", "-" skips an output, lines starting with # are ignored
+std::vector<BatchJob> collectBatchJobs(const Args& args){
+    namespace fs = std::filesystem;
+    std::vector<BatchJob> jobs;
+
+    const char* transcript_extension = ".txt";
+    if (args.transcript_options.format == TranscriptFormat::csv) transcript_extension = ".csv";
+    if (args.transcript_options.format == TranscriptFormat::binary) transcript_extension = ".atr";
+
+    if (fs::is_directory(args.batch_path)){
+        if (args.output_dir.empty()) throw std::runtime_error("--output_dir is required when --batch is a directory");
+        fs::create_directories(args.output_dir);
+        if (fs::equivalent(args.batch_path, args.output_dir)) throw std::runtime_error("--output_dir must differ from the input directory");
+
+        for (const fs::directory_entry& entry : fs::directory_iterator(args.batch_path)){
+            if (!entry.is_regular_file() || entry.path().extension() != ".wav") continue;
+            BatchJob job;
+            job.input_audio_file_path = entry.path().string();
+            job.output_audio_file_path = (fs::path(args.output_dir) / entry.path().stem()).string() + ".wav";
+            job.transcript_file_path = (fs::path(args.output_dir) / entry.path().stem()).string() + transcript_extension;
+            jobs.push_back(job);
+        }
+    }else{
+        std::ifstream manifest(args.batch_path);
+        if (!manifest.is_open()) throw std::runtime_error("The batch manifest cannot be opened");
+
+        std::string line;
+        while (std::getline(manifest, line)){
+            std::istringstream fields(line);
+            BatchJob job;
+            if (!(fields >> job.input_audio_file_path) || job.input_audio_file_path[0] == '#') continue;
+            if (!(fields >> job.output_audio_file_path >> job.transcript_file_path)){
+                throw std::runtime_error("Malformed manifest line: " + line);
+            }
+            if (job.output_audio_file_path == "-") job.output_audio_file_path.clear();
+            if (job.transcript_file_path == "-") job.transcript_file_path.clear();
+            jobs.push_back(job);
+        }
+    }
+
+    for (BatchJob& job : jobs){
+        std::error_code error;
+        std::uintmax_t size = fs::file_size(job.input_audio_file_path, error);
+        job.input_size = error ? 0 : size;
+    }
+    return jobs;
+}
+
+// files are distributed over the thread pool largest first, so that a long recording does not start last
+// FFT plans and the note table are process wide caches, the plans are kept up to a memory limit (least recently used
+// ones first out), since whole-file analysis can need new plans for every file length
+// returns the number of failed files, a failure does not stop the remaining jobs
+int transcribeBatch(const Args& args){
+    std::vector<BatchJob> jobs = collectBatchJobs(args);
+    std::vector<size_t> order(jobs.size());
+    for (size_t i = 0; i<order.size(); i++) order[i] = i;
+    std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b){return jobs[a].input_size > jobs[b].input_size;});
+
+    // the parallelism is spread over files, every file is analyzed on the worker that picked it up
+    AnalysisOptions job_options = args.analysis_options;
+    job_options.threads = 1;
+    const AudioAnalyzer analyzer(args.segment_size, args.num_frequencies, job_options);
+    AudioOutputOptions audio_options = args.audio_options;
+    audio_options.threads = 1;
+    std::unique_ptr<ResultCache> cache;
+    if (!args.cache_dir.empty()) cache = std::make_unique<ResultCache>(args.cache_dir, args.cache_size_mb << 20);
+
+    std::vector<std::function<void()>> tasks;
+    for (size_t i : order){
+        BatchJob* job = &jobs[i];
+        tasks.emplace_back([&analyzer, &args, &audio_options, &cache, job](){
+            try {
+                transcribeFile(analyzer, job->input_audio_file_path, job->output_audio_file_path, job->transcript_file_path, args.streaming, audio_options, args.transcript_options, cache.get());
+            }catch(const std::exception& e){
+                job->error = e.what();
+            }
+        });
+    }
+    WorkStealingPool pool(args.analysis_options.threads);
+    pool.run(tasks);
+
+    int failed = 0;
+    for (const BatchJob& job : jobs){
+        if (job.error.empty()) continue;
+        std::cerr << job.input_audio_file_path << ": " << job.error << "\n";
+        failed++;
+    }
+    if (failed > 0) std::cerr << failed << " of " << jobs.size() << " files failed\n";
+    return failed;
+}
+
+int main(int argc, char *argv[]) {
+
+    Args args = parse_args(argc, argv);
+    if (!args.profile_path.empty()){
+#ifdef AUDIO_TRANSCRIBER_COUNT_ALLOCATIONS
+        // the replacement allocation functions are linked in, they only count from here on
+        AllocationCounter::enable();
+        Profiler::set_allocation_counter(&AllocationCounter::thread_count);
+#endif
+        Profiler::enable();
+    }
+
+    int status = 0;
+    try {
+        if (!args.batch_path.empty()){
+            status = transcribeBatch(args) == 0 ? 0 : 1;
+        }else if (args.live){
+            transcribeLive(AudioAnalyzer(args.segment_size, args.num_frequencies, args.analysis_options), args);
+        }else{
+            AudioAnalyzer analyzer(args.segment_size, args.num_frequencies, args.analysis_options);
+            std::unique_ptr<ResultCache> cache;
+            if (!args.cache_dir.empty()) cache = std::make_unique<ResultCache>(args.cache_dir, args.cache_size_mb << 20);
+            transcribeFile(analyzer, args.input_audio_file_path, args.output_audio_file_path, args.transcript_file_path, args.streaming, args.audio_options, args.transcript_options, cache.get());
+        }
+        if (!args.profile_path.empty()) Profiler::write_json(args.profile_path);
+    }catch(const std::exception& e){
+        std::cerr << e.what() << "\n";
+        return 1;
     }
 
-    return 0;
+    return status;
 }
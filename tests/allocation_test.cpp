@@ -0,0 +1,118 @@
+//
+// Created by Samuel Longauer on 17/10/2026.
+//
+
+#include <cmath>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <numbers>
+#include <string>
+#include <vector>
+#include "audio_analysis.h"
+#include "allocation_counter.h"
+#include "test_support.h"
+
+namespace fs = std::filesystem;
+
+constexpr int sample_rate = 44100;
+
+// a C major chord at 16-bit scale
+std::vector<int> chord_signal(size_t num_samples){
+    std::vector<int> samples(num_samples);
+    for (size_t i = 0; i<num_samples; i++){
+        double t = static_cast<double>(i)/sample_rate, value = 0;
+        for (double f : {261.626, 329.628, 391.995}) value += std::sin(2*std::numbers::pi*f*t);
+        samples[i] = static_cast<int>(8000*value);
+    }
+    return samples;
+}
+
+// heap allocations made by the calling thread while running f
+template<typename F>
+size_t allocations_of(F&& f){
+    size_t before = AllocationCounter::thread_count();
+    f();
+    return AllocationCounter::thread_count() - before;
+}
+
+// once the workspace of the thread is sized for the largest segment, analyzing segments (of any length up to it)
+// does not touch the heap
+void test_segments(const char* name, AnalysisOptions options){
+    const AudioAnalyzer analyzer(0, 4, options);
+    std::vector<int> signal = chord_signal(sample_rate);
+    std::span<const int> longer(signal.data(), signal.size());
+    std::span<const int> shorter(signal.data(), signal.size()/3);
+    segment_chord chord;
+    analyzer.analyzeSegment(longer, sample_rate, chord, longer.size());
+    analyzer.analyzeSegment(shorter, sample_rate, chord, longer.size());
+    CHECK(!chord.notes.empty());
+
+    size_t allocations = allocations_of([&](){
+        for (int i = 0; i<4; i++){
+            analyzer.analyzeSegment(longer, sample_rate, chord, longer.size());
+            analyzer.analyzeSegment(shorter, sample_rate, chord, longer.size());
+        }
+    });
+    if (allocations != 0) std::fprintf(stderr, "%s: %zu allocations\n", name, allocations);
+    CHECK(allocations == 0);
+}
+
+// a stage entry of the "total" object of a profile written by Profiler::write_json
+uint64_t profile_field(const std::string& path, const std::string& stage, const std::string& field){
+    std::ifstream in(path);
+    std::string json((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    size_t at = json.find("\"" + stage + "\"", json.find("\"total\""));
+    at = json.find("\"" + field + "\": ", at);
+    if (at == std::string::npos) return 0;
+    return std::stoull(json.substr(at + field.size() + 4));
+}
+
+// the frames of the short-time fourier transform are only reachable through a whole analysis - the allocations inside
+// the segment stage (one per frame) are read from the profile, a second run of the warmed-up analyzer adds none
+void test_stft_frames(){
+    fs::path wav = fs::temp_directory_path() / "allocation_test_stft.wav";
+    fs::path profile = fs::temp_directory_path() / "allocation_test_profile.json";
+    write_wav(wav.string(), chord_signal(2*sample_rate), sample_rate);
+
+    AnalysisOptions options;
+    options.hop_size = 0.05;
+    const AudioAnalyzer analyzer(0.2, 4, options);
+    Profiler::set_allocation_counter(&AllocationCounter::thread_count);
+    Profiler::enable();
+
+    analyzer.analyzeAudio(wav.string());
+    Profiler::write_json(profile.string());
+    uint64_t calls = profile_field(profile.string(), "segment", "calls");
+    uint64_t allocations = profile_field(profile.string(), "segment", "allocations");
+
+    analyzer.analyzeAudio(wav.string());
+    Profiler::write_json(profile.string());
+    CHECK(profile_field(profile.string(), "segment", "calls") > calls);
+    uint64_t added = profile_field(profile.string(), "segment", "allocations") - allocations;
+    if (added != 0) std::fprintf(stderr, "stft: %llu allocations\n", static_cast<unsigned long long>(added));
+    CHECK(added == 0);
+
+    fs::remove(wav);
+    fs::remove(profile);
+}
+
+int main(){
+    AllocationCounter::enable();
+    // the counter has to see the allocations at all, otherwise every check below passes trivially
+    static int* volatile sink = nullptr;
+    CHECK(allocations_of([](){sink = new int(1);}) == 1);
+    delete sink;
+
+    AnalysisOptions options;
+    test_segments("double", options);
+    options.precision = Precision::single_precision;
+    test_segments("float", options);
+    options = AnalysisOptions();
+    options.engine = Engine::cqt;
+    test_segments("cqt", options);
+    options.precision = Precision::single_precision;
+    test_segments("cqt float", options);
+    test_stft_frames();
+    return test_result();
+}
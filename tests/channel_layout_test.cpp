@@ -0,0 +1,81 @@
+//
+// Created by Samuel Longauer on 18/10/2026.
+//
+
+#include <cmath>
+#include <cstdio>
+#include <filesystem>
+#include <numbers>
+#include <span>
+#include <string>
+#include <vector>
+#include "audio_analysis.h"
+#include "test_support.h"
+
+namespace fs = std::filesystem;
+
+constexpr int sample_rate = 44100;
+
+// sum of sines at 16-bit scale
+std::vector<int> tones(size_t num_samples, const std::vector<std::pair<double, double>>& partials){
+    std::vector<int> samples(num_samples);
+    for (size_t i = 0; i<num_samples; i++){
+        double t = static_cast<double>(i)/sample_rate, value = 0;
+        for (auto [frequency, amplitude] : partials) value += amplitude*std::sin(2*std::numbers::pi*frequency*t);
+        samples[i] = static_cast<int>(std::lround(value));
+    }
+    return samples;
+}
+
+bool has_note(const std::vector<segment_chord>& channel, const std::string& label){
+    for (const segment_chord& chord : channel){
+        for (const NoteClassifier& note : chord.notes) if (note.repr() == label) return true;
+    }
+    return false;
+}
+
+// identical channels share their analysis, correlated ones only when a threshold is given
+void test_duplicate_channels(){
+    std::vector<int> first = tones(sample_rate, {{440, 8000}});
+    std::vector<int> quieter = tones(sample_rate, {{440, 2000}});
+    std::vector<int> delayed(first.size(), 0);
+    std::copy(quieter.begin(), quieter.end() - 100, delayed.begin() + 100);
+    std::vector<std::span<const int>> channels = {first, first, quieter, delayed};
+
+    CHECK((duplicateChannels(channels, AnalysisOptions().duplicate_threshold) == std::vector<int>{0, 0, 2, 3}));
+    // the delayed copy starts later, its segments would be timed differently
+    CHECK((duplicateChannels(channels, 0.999) == std::vector<int>{0, 0, 0, 3}));
+}
+
+// channel 2 is channel 1 with an extra partial 35 dB below it: correlated far above 0.999,
+// but by default it is analyzed on its own and reports the partial
+void test_near_duplicate_keeps_its_notes(){
+    const std::vector<std::pair<double, double>> chord = {{440, 8000}, {554.37, 8000}};
+    std::vector<int> left = tones(2*sample_rate, chord);
+    std::vector<int> right = tones(2*sample_rate, {{440, 8000}, {554.37, 8000}, {1174.66, 8000*std::pow(10.0, -35.0/20)}});
+    std::vector<int> interleaved;
+    for (size_t i = 0; i<left.size(); i++){
+        interleaved.push_back(left[i]);
+        interleaved.push_back(right[i]);
+    }
+    fs::path wav = fs::temp_directory_path() / "channel_layout_test.wav";
+    write_wav(wav.string(), interleaved, sample_rate, 2);
+
+    channel_field result = AudioAnalyzer(0.5, 3).analyzeAudio(wav.string());
+    CHECK(result.size() == 2);
+    CHECK(!has_note(result.at(0), "D(6)"));
+    CHECK(has_note(result.at(1), "D(6)"));
+
+    // merging near copies is still available on request
+    AnalysisOptions options;
+    options.duplicate_threshold = 0.999;
+    result = AudioAnalyzer(0.5, 3, options).analyzeAudio(wav.string());
+    CHECK(!has_note(result.at(1), "D(6)"));
+    fs::remove(wav);
+}
+
+int main(){
+    test_duplicate_channels();
+    test_near_duplicate_keeps_its_notes();
+    return test_result();
+}
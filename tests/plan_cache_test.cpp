@@ -0,0 +1,105 @@
+//
+// Created by Samuel Longauer on 18/10/2026.
+//
+
+#include <cmath>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <numbers>
+#include <string>
+#include <vector>
+#include "audio_analysis.h"
+#include "test_support.h"
+
+namespace fs = std::filesystem;
+
+constexpr int sample_rate = 44100;
+constexpr size_t cache_limit = size_t(32) << 20;
+
+// a C major chord at 16-bit scale
+std::vector<int> chord_signal(size_t num_samples){
+    std::vector<int> samples(num_samples);
+    for (size_t i = 0; i<num_samples; i++){
+        double t = static_cast<double>(i)/sample_rate, value = 0;
+        for (double f : {261.626, 329.628, 391.995}) value += std::sin(2*std::numbers::pi*f*t);
+        samples[i] = static_cast<int>(8000*value);
+    }
+    return samples;
+}
+
+// resident memory of the process in bytes, 0 where /proc is not available
+size_t resident_bytes(){
+    std::ifstream statm("/proc/self/statm");
+    size_t pages = 0, resident = 0;
+    if (!(statm >> pages >> resident)) return 0;
+    return resident*4096;
+}
+
+std::vector<std::string> labels(const channel_field& result){
+    std::vector<std::string> notes;
+    for (const segment_chord& chord : result.at(0)){
+        for (const NoteClassifier& note : chord.notes) notes.push_back(note.repr());
+    }
+    return notes;
+}
+
+// whole-file analysis of a batch where every file has its own length longer than 4 seconds: each length needs
+// its own plans, the cache has to stay within its limit and the process must not grow with every file
+void test_batch_of_lengths(){
+    FFTPlan::set_cache_limit(cache_limit);
+    const AudioAnalyzer analyzer(0, 3);
+    std::vector<fs::path> files;
+    for (int i = 0; i<8; i++){
+        // largest first like the batch mode, the workspace is sized by the first file
+        fs::path wav = fs::temp_directory_path() / ("plan_cache_test_" + std::to_string(i) + ".wav");
+        write_wav(wav.string(), chord_signal(9*sample_rate - i*sample_rate/2 + 37*i), sample_rate);
+        files.push_back(wav);
+    }
+
+    std::vector<std::string> first = labels(analyzer.analyzeAudio(files[0].string()));
+    CHECK(first.size() == 3);
+    const size_t resident_after_first = resident_bytes();
+    size_t largest_cache = 0;
+    for (const fs::path& wav : files){
+        analyzer.analyzeAudio(wav.string());
+        largest_cache = std::max(largest_cache, FFTPlan::cache_bytes());
+    }
+    const size_t resident_after_all = resident_bytes();
+
+    if (largest_cache > cache_limit) std::fprintf(stderr, "plan cache: %zu bytes\n", largest_cache);
+    CHECK(largest_cache <= cache_limit);
+    if (resident_after_first != 0){
+        size_t growth = resident_after_all > resident_after_first ? resident_after_all - resident_after_first : 0;
+        if (growth > cache_limit) std::fprintf(stderr, "resident memory grew by %zu bytes\n", growth);
+        CHECK(growth <= cache_limit);
+    }
+
+    // the plans of the first file were evicted meanwhile, rebuilding them gives the same notes
+    CHECK(labels(analyzer.analyzeAudio(files[0].string())) == first);
+    for (const fs::path& wav : files) fs::remove(wav);
+}
+
+// a plan stays valid while it is used even when the cache drops it (a bluestein plan keeps its convolution plan)
+void test_evicted_plans_in_use(){
+    FFTPlan::set_cache_limit(0);
+    std::shared_ptr<const FFTPlan> mixed_radix = FFTPlan::get(1000);
+    std::shared_ptr<const FFTPlan> bluestein = FFTPlan::get(1001);
+    CHECK(bluestein->algorithm() == FFTPlan::Algorithm::bluestein);
+    CHECK(FFTPlan::cache_bytes() == bluestein->size_bytes());
+    FFTPlan::set_cache_limit(0);
+
+    for (const std::shared_ptr<const FFTPlan>& plan : {mixed_radix, bluestein}){
+        std::vector<std::complex<double>> data(plan->size(), std::complex<double>(1, 0));
+        plan->forward(data.data());
+        CHECK(std::abs(data[0] - std::complex<double>(static_cast<double>(plan->size()), 0)) < 1e-6);
+        CHECK(std::abs(data[1]) < 1e-6);
+    }
+    FFTPlan::set_cache_limit(cache_limit);
+}
+
+int main(){
+    test_batch_of_lengths();
+    test_evicted_plans_in_use();
+    return test_result();
+}
@@ -0,0 +1,51 @@
+//
+// Created by Samuel Longauer on 17/10/2026.
+//
+
+#ifndef PROJECT_TEST_SUPPORT_H
+#define PROJECT_TEST_SUPPORT_H
+
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <string>
+#include <vector>
+
+// minimal checks for the test executables - a failed check is reported and the test exits with test_result() == 1
+inline int test_failures = 0;
+
+#define CHECK(condition) do { \
+    if (!(condition)){ \
+        std::fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #condition); \
+        test_failures++; \
+    } \
+} while (0)
+
+inline int test_result(){
+    if (test_failures == 0) std::printf("all checks passed\n");
+    return test_failures == 0 ? 0 : 1;
+}
+
+// 16-bit pcm file of the interleaved samples
+inline void write_wav(const std::string& path, const std::vector<int>& samples, int sample_rate, int channels = 1){
+    std::ofstream out(path, std::ios::binary);
+    auto put = [&](uint32_t value, int bytes){
+        for (int i = 0; i<bytes; i++) out.put(static_cast<char>((value >> (8*i)) & 0xff));
+    };
+    const uint32_t data_size = static_cast<uint32_t>(samples.size()*2);
+    out.write("RIFF", 4);
+    put(36 + data_size, 4);
+    out.write("WAVEfmt ", 8);
+    put(16, 4);
+    put(1, 2); // pcm
+    put(channels, 2);
+    put(sample_rate, 4);
+    put(sample_rate*channels*2, 4);
+    put(channels*2, 2);
+    put(16, 2);
+    out.write("data", 4);
+    put(data_size, 4);
+    for (int sample : samples) put(static_cast<uint16_t>(static_cast<int16_t>(sample)), 2);
+}
+
+#endif //PROJECT_TEST_SUPPORT_H
@@ -0,0 +1,71 @@
+//
+// Created by Samuel Longauer on 17/10/2026.
+//
+
+#include <atomic>
+#include <functional>
+#include <stdexcept>
+#include <vector>
+#include "thread_pool.h"
+#include "test_support.h"
+
+// every task of a batch runs exactly once
+void test_each_task_once(){
+    WorkStealingPool pool(4);
+    std::vector<int> counts(1000, 0);
+    std::vector<std::function<void()>> tasks;
+    for (size_t i = 0; i<counts.size(); i++) tasks.emplace_back([&counts, i](){counts[i]++;});
+    pool.run(tasks);
+    for (int count : counts) CHECK(count == 1);
+}
+
+// batches run back to back - a worker still leaving the previous batch must not miss the count of the next one
+// (small batches, so that the workers are often caught between two batches)
+void test_back_to_back(){
+    for (unsigned workers : {2u, 3u, 8u}){
+        WorkStealingPool pool(workers);
+        std::atomic<size_t> executed{0};
+        size_t expected = 0;
+        for (int iteration = 0; iteration<200000/static_cast<int>(workers); iteration++){
+            std::vector<std::function<void()>> tasks(1 + iteration % 5, [&executed](){executed.fetch_add(1, std::memory_order_relaxed);});
+            expected += tasks.size();
+            pool.run(tasks);
+            if (executed.load() != expected){
+                CHECK(executed.load() == expected);
+                return;
+            }
+        }
+    }
+}
+
+// the first exception is rethrown by run(), the other tasks still run and the next batch starts clean
+void test_exception(){
+    WorkStealingPool pool(3);
+    std::atomic<int> executed{0};
+    std::vector<std::function<void()>> tasks;
+    for (int i = 0; i<10; i++){
+        tasks.emplace_back([&executed, i](){
+            executed++;
+            if (i == 4) throw std::runtime_error("task failed");
+        });
+    }
+    bool thrown = false;
+    try {
+        pool.run(tasks);
+    }catch(const std::runtime_error&){
+        thrown = true;
+    }
+    CHECK(thrown);
+    CHECK(executed.load() == 10);
+
+    std::vector<std::function<void()>> clean(4, [&executed](){executed++;});
+    pool.run(clean);
+    CHECK(executed.load() == 14);
+}
+
+int main(){
+    test_each_task_once();
+    test_back_to_back();
+    test_exception();
+    return test_result();
+}